@@ -8,7 +8,9 @@
 
 #include <cstdint>
 
-uint8_t rom[1024] = {
+extern const uint8_t rom[1024];
+
+const uint8_t rom[1024] = {
 	0x70,0x75,0x6e,0x63,0x68,0x20,0x72,0x6f,0x6d,0x20,0x76,0x30,0x2e,0x34,0x20,0x32,
 	0x30,0x32,0x34,0x31,0x32,0x31,0x30,0x00,0x10,0xce,0x04,0x00,0xce,0xfc,0x00,0xbd,
 	0xfc,0xe5,0xcc,0x00,0x07,0xfd,0x0a,0xc4,0xcc,0x00,0x12,0xfd,0x0a,0xc6,0x86,0x10,
@@ -48,7 +48,8 @@ int main(int argc, char *argv[])
 	fprintf(f, " * %s",ctime(&t));
 	fprintf(f, " */\n\n");
 	fprintf(f, "#include <cstdint>\n\n");
-	fprintf(f, "uint8_t rom[1024] = {");
+	fprintf(f, "extern const uint8_t rom[1024];\n\n");
+	fprintf(f, "const uint8_t rom[1024] = {");
 
 	for(int i = 0; i < 1023; i++) {
 		if(i%16 == 0) fprintf(f, "\n\t");
@@ -21,12 +21,28 @@ mc6809::mc6809()
 	irq_line = &default_pin;
 
 	cycles = 0;
+	instruction_start_cycles = 0;
+	next_event_cycles = 0;
 
 	index_regs[0b00] = &xr;
 	index_regs[0b01] = &yr;
 	index_regs[0b10] = &us;
 	index_regs[0b11] = &sp;
 
+	/*
+	 * Decode cache starts empty, with no pages cacheable
+	 */
+	decode_cache = new decoded_instruction_t[65536];
+	for (int i=0; i<65536; i++) {
+		decode_cache[i].kind = DECODED_NONE;
+	}
+	for (int i=0; i<256; i++) {
+		decode_page_cacheable[i] = false;
+		decode_page_used[i] = false;
+	}
+	pair_profile = NULL;
+	pair_profile_previous = 0;
+
 	breakpoint_array = NULL;
 	breakpoint_array = new bool[65536];
 	clear_breakpoints();
@@ -41,6 +57,8 @@ mc6809::mc6809()
 mc6809::~mc6809()
 {
 	printf("[MC6809] cleaning up\n");
+	if (pair_profile) delete [] pair_profile;
+	delete [] decode_cache;
 	delete breakpoint_array;
 }
 
@@ -70,6 +88,8 @@ void mc6809::reset()
 	 */
 	cpu_state = CPU_NORMAL;
 
+	flush_decode_cache();
+
 	/*
 	 * Load program counter from vector
 	 */
@@ -78,35 +98,81 @@ void mc6809::reset()
 	pc |= read8(VECTOR_RESET+1);
 }
 
+void mc6809::get_state(struct mc6809_state_t *state)
+{
+	state->pc = pc;
+	state->dp = dp;
+	state->ac = ac;
+	state->br = br;
+	state->xr = xr;
+	state->yr = yr;
+	state->us = us;
+	state->sp = sp;
+	state->cc = cc;
+	state->cpu_state = cpu_state;
+	state->nmi_enabled = nmi_enabled;
+	state->old_nmi_line = old_nmi_line;
+	state->cycles = cycles;
+}
+
+void mc6809::set_state(const struct mc6809_state_t *state)
+{
+	pc = state->pc;
+	dp = state->dp;
+	ac = state->ac;
+	br = state->br;
+	xr = state->xr;
+	yr = state->yr;
+	us = state->us;
+	sp = state->sp;
+	cc = state->cc;
+	cpu_state = (enum cpu_state_t)state->cpu_state;
+	nmi_enabled = state->nmi_enabled;
+	old_nmi_line = state->old_nmi_line;
+	cycles = state->cycles;
+	instruction_start_cycles = cycles;
+	next_event_cycles = cycles;
+
+	flush_decode_cache();
+}
+
 uint16_t mc6809::execute()
 {
 	uint32_t old_cycles = cycles;
+	instruction_start_cycles = cycles;
 
 	if ((*nmi_line == false) && (old_nmi_line == true) && nmi_enabled) {
+		if (cpu_state == CPU_CWAI) {
+			cwai_exception(VECTOR_NMI, true);
+		} else {
+			nmi();
+		}
 		cpu_state = CPU_NORMAL;
-		nmi();
 	} else if ((*firq_line == false) && is_f_flag_clear()) {
+		if (cpu_state == CPU_CWAI) {
+			cwai_exception(VECTOR_FIRQ, true);
+		} else {
+			firq();
+		}
 		cpu_state = CPU_NORMAL;
-		firq();
 	} else if ((*irq_line == false) && is_i_flag_clear()) {
+		if (cpu_state == CPU_CWAI) {
+			cwai_exception(VECTOR_IRQ, false);
+		} else {
+			irq();
+		}
 		cpu_state = CPU_NORMAL;
-		irq();
 	} else {
 		if (cpu_state == CPU_NORMAL) {
-			uint8_t opcode = read8(pc++);
-			/*
-			* TODO: check for illegal opcode and start exception
-			*/
-			cycles += cycles_page1[opcode];
-			bool am_legal;
-			uint16_t effective_address = (this->*addressing_modes_page1[opcode])(&am_legal);
-			(this->*opcodes_page1[opcode])(effective_address);
+			if (decode_page_cacheable[pc >> 8]) {
+				execute_decoded();
+			} else {
+				execute_fetched();
+			}
 		} else if (cpu_state == CPU_SYNC) {
-			cycles += SYNC_CYCLES;
+			cycles += SYNC_CYCLES * idle_steps(SYNC_CYCLES);
 		} else {
-			// TODO: fixme
-			// for status CWAI????
-			cycles += CWAI_CYCLES;
+			cycles += CWAI_CYCLES * idle_steps(CWAI_CYCLES);
 		}
 	}
 
@@ -114,9 +180,26 @@ uint16_t mc6809::execute()
 	return cycles - old_cycles;
 }
 
+void mc6809::execute_fetched()
+{
+	uint8_t opcode = read8(pc++);
+	/*
+	* TODO: check for illegal opcode and start exception
+	*/
+	cycles += cycles_page1[opcode];
+	bool am_legal;
+	uint16_t effective_address = (this->*addressing_modes_page1[opcode])(&am_legal);
+	(this->*opcodes_page1[opcode])(effective_address);
+}
+
 void mc6809::toggle_breakpoint(uint16_t address)
 {
 	breakpoint_array[address] = !breakpoint_array[address];
+
+	/*
+	 * Superinstructions never span a breakpoint
+	 */
+	flush_decode_cache();
 }
 
 void mc6809::clear_breakpoints()
@@ -124,6 +207,7 @@ void mc6809::clear_breakpoints()
 	for (int i=0; i<65536; i++) {
 		breakpoint_array[i] = false;
 	}
+	flush_decode_cache();
 }
 
 void mc6809::nmi()
@@ -197,6 +281,20 @@ void mc6809::irq()
 	cycles += 19;
 }
 
+void mc6809::cwai_exception(uint16_t vector, bool mask_firq)
+{
+	set_i_flag();
+	if (mask_firq) set_f_flag();
+	pc = 0;
+	pc = read8(vector) << 8;
+	pc |= read8(vector+1);
+
+	/*
+	 * Stacking was done by cwai, only the vector fetch remains
+	 */
+	cycles += 5;
+}
+
 void mc6809::illegal_opcode()
 {
 	push_sp(pc & 0x00ff);
@@ -68,12 +68,44 @@
 #define SYNC_CYCLES	50
 #define CWAI_CYCLES	50
 
+/*
+ * Max number of cycles skipped in one call to execute() while idling
+ * (sync, cwai or a branch to itself).
+ */
+#define MAX_IDLE_CYCLES	32768
+
+/*
+ * Max number of instructions decoded in one go by the decode cache. A
+ * block ends earlier at a page boundary or at a change of flow.
+ */
+#define DECODE_BLOCK_SIZE	32
+
 enum cpu_state_t {
 	CPU_NORMAL = 0,
 	CPU_CWAI,
 	CPU_SYNC
 };
 
+/*
+ * Complete register and interrupt state, e.g. for snapshots. Doesn't
+ * include breakpoints, the decode cache and profiling data.
+ */
+struct mc6809_state_t {
+	uint16_t pc;
+	uint8_t  dp;
+	uint8_t  ac;
+	uint8_t  br;
+	uint16_t xr;
+	uint16_t yr;
+	uint16_t us;
+	uint16_t sp;
+	uint8_t  cc;
+	uint8_t  cpu_state;
+	bool     nmi_enabled;
+	bool     old_nmi_line;
+	uint32_t cycles;
+};
+
 const char cpu_state_description[3][5] = {
 	"run",
 	"halt",
@@ -110,6 +142,13 @@ public:
 	 */
 	uint16_t execute();
 
+	/*
+	 * Setting the state flushes the decode cache, memory may have
+	 * changed as well
+	 */
+	void get_state(struct mc6809_state_t *state);
+	void set_state(const struct mc6809_state_t *state);
+
 	void status(char *text_buffer, int n);
 	void stacks(char *text_buffer, int n, int no);
 	uint16_t disassemble_instruction(char *buffer, size_t n, uint16_t address);
@@ -188,6 +227,45 @@ public:
 
 	inline uint32_t clock_ticks() { return cycles; }
 
+	/*
+	 * Clock ticks at the start of the instruction being executed. Lets
+	 * the host stay cycle exact on io access within superinstructions.
+	 */
+	inline uint32_t clock_ticks_instruction_start() { return instruction_start_cycles; }
+
+	/*
+	 * The host tells at which clock tick its next event (e.g. a timer
+	 * interrupt or end of frame) is due. Superinstructions won't run
+	 * past it, just like single instructions would have. When idle
+	 * (sync, cwai, bra *), the cpu skips ahead to it.
+	 */
+	inline void set_next_event(uint32_t ticks) { next_event_cycles = ticks; }
+
+	/*
+	 * Decode cache. Straight-line blocks of code are decoded once into
+	 * an array of predecoded instructions (instruction handler, cycles,
+	 * effective address or addressing mode and next pc), and executed
+	 * from there. Only pages marked cacheable by the host are cached,
+	 * these must be plain ram or rom without side effects on reading.
+	 * The host is responsible for calling invalidate_decode_cache() on
+	 * every write into a cacheable page (write8() can't be seen from
+	 * here), or flush_decode_cache() when memory changes otherwise.
+	 */
+	void set_decode_cache_page(uint8_t page, bool cacheable);
+	inline void invalidate_decode_cache(uint16_t address) {
+		if (decode_page_used[address >> 8]) flush_decode_page(address >> 8);
+	}
+	void flush_decode_cache();
+
+	/*
+	 * Pair profiling. Counts how often two (cached) instructions are
+	 * executed back to back, to see which pairs are worth fusing.
+	 * While profiling, superinstructions are disabled.
+	 */
+	void set_pair_profile(bool profile);
+	bool pair_profile_enabled() { return pair_profile != NULL; }
+	void pair_profile_report(char *text_buffer, int n, int no);
+
 private:
 	uint16_t pc;	// program counter
 	uint8_t	 dp;	// direct page register
@@ -216,10 +294,109 @@ private:
 
 	int32_t cycle_saldo;
 	uint32_t cycles;
+	uint32_t instruction_start_cycles;
+	uint32_t next_event_cycles;
+
+	/*
+	 * Scratch values used by individual instructions. These are
+	 * members (not globals) so that several cpu instances can run
+	 * on different threads at the same time.
+	 */
+	uint8_t  byte;
+	uint16_t word;
+	uint32_t dword;
+
+	/*
+	 * d_reg is a stand-in temporary variable to ease calculations
+	 * during individual instructions that deal with the d register
+	 */
+	uint16_t d_reg;
 
 	typedef uint16_t (mc6809::*addressing_mode)(bool *legal);
 	typedef void (mc6809::*execute_instruction)(uint16_t);
 
+	enum decoded_kind_t {
+		DECODED_NONE = 0,	// not decoded (yet)
+		DECODED_EA,		// effective address known at decode time
+		DECODED_DIRECT,		// low byte known, high byte is dp
+		DECODED_DYNAMIC,	// run addressing mode (indexed)
+		DECODED_SLOW		// not cacheable, use normal fetch
+	};
+
+	struct decoded_instruction_t;
+	typedef void (mc6809::*execute_fused)(decoded_instruction_t *d);
+
+	struct decoded_instruction_t {
+		execute_instruction instruction;
+		addressing_mode mode;
+		execute_fused fused;	// superinstruction, NULL if none
+		uint16_t ea;
+		uint16_t next_pc;	// pc before running addressing mode
+		uint16_t next_instruction;
+		uint16_t cycles;
+		uint16_t opcode;	// (0, 1 or 2 for page 1, 2 or 3) << 8 | opcode
+		uint16_t operand;	// immediate operand, if any
+		uint8_t kind;
+	};
+
+	decoded_instruction_t *decode_cache;
+	bool decode_page_cacheable[256];
+	bool decode_page_used[256];
+
+	void flush_decode_page(uint8_t page);
+	void decode_block(uint16_t address);
+	bool ends_block(execute_instruction instruction, addressing_mode mode, uint16_t operand);
+	int indexed_extra_bytes(uint8_t postbyte);
+	void fuse_block(decoded_instruction_t **block, int no);
+	void execute_decoded();
+	void execute_fetched();
+
+	inline void run_decoded(decoded_instruction_t *d) {
+		execute_instruction instruction = d->instruction;
+		uint16_t effective_address;
+		bool am_legal;
+
+		cycles += d->cycles;
+		pc = d->next_pc;
+
+		switch (d->kind) {
+			case DECODED_EA:
+				effective_address = d->ea;
+				break;
+			case DECODED_DIRECT:
+				effective_address = (dp << 8) | d->ea;
+				break;
+			default:
+				effective_address = (this->*d->mode)(&am_legal);
+				break;
+		}
+		(this->*instruction)(effective_address);
+	}
+
+	/*
+	 * Superinstructions. The second (and third) instruction of a fused
+	 * sequence is only executed if it's still cached, no interrupt is
+	 * pending and the next host event isn't due yet. Otherwise execution
+	 * continues normally at its pc.
+	 */
+	inline bool fusion_break(decoded_instruction_t *next) {
+		return
+			(next->kind == DECODED_NONE) ||
+			((int32_t)(cycles - next_event_cycles) >= 0) ||
+			((*nmi_line == false) && (old_nmi_line == true) && nmi_enabled) ||
+			((*firq_line == false) && is_f_flag_clear()) ||
+			((*irq_line == false) && is_i_flag_clear());
+	}
+	void f_pair(decoded_instruction_t *d);
+	void f_ld8_st8(decoded_instruction_t *d);
+	void f_ld16_st16(decoded_instruction_t *d);
+	void f_idle_loop(decoded_instruction_t *d);
+
+	uint32_t *pair_profile;
+	uint16_t pair_profile_previous;
+
+	const char *opcode_mnemonic(uint16_t opcode);
+
 	bool disassemble_success;
 
 	/*
@@ -232,6 +409,25 @@ private:
 	void irq();
 	void illegal_opcode();
 
+	/*
+	 * Exception after cwai, the entire state is already on the stack
+	 */
+	void cwai_exception(uint16_t vector, bool mask_firq);
+
+	/*
+	 * Idle fast forward. Instead of spending step cycles per call of
+	 * execute(), skip ahead in multiples of step up to the first step
+	 * at or beyond the next host event. As no interrupt is pending and
+	 * nothing changes until that event, this is cycle exact.
+	 */
+	inline uint32_t idle_steps(uint16_t step) {
+		int32_t remaining = (int32_t)(next_event_cycles - cycles);
+		if (remaining <= step) return 1;
+		uint32_t steps = (remaining + step - 1) / step;
+		if ((steps * step) > MAX_IDLE_CYCLES) steps = MAX_IDLE_CYCLES / step;
+		return steps;
+	}
+
 	/*
 	 * Internal stackpointer functionality
 	 */
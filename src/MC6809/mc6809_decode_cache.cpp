@@ -0,0 +1,403 @@
+/*
+ * mc6809_decode_cache.cpp  -  part of MC6809
+ *
+ * (C)2021-2025 elmerucr
+ */
+
+#include "mc6809.hpp"
+#include <cstdio>
+
+void mc6809::set_decode_cache_page(uint8_t page, bool cacheable)
+{
+	flush_decode_page(page);
+	decode_page_cacheable[page] = cacheable;
+}
+
+void mc6809::flush_decode_cache()
+{
+	for (int i=0; i<256; i++) {
+		flush_decode_page(i);
+	}
+}
+
+void mc6809::flush_decode_page(uint8_t page)
+{
+	if (decode_page_used[page]) {
+		decoded_instruction_t *d = &decode_cache[page << 8];
+		for (int i=0; i<256; i++) {
+			d[i].kind = DECODED_NONE;
+		}
+		decode_page_used[page] = false;
+	}
+}
+
+/*
+ * Number of bytes following the postbyte of an indexed instruction
+ */
+int mc6809::indexed_extra_bytes(uint8_t postbyte)
+{
+	if (!(postbyte & 0b10000000)) return 0;	// 5 bit offset
+	if (postbyte == 0b10011111) return 2;	// indirect extended
+
+	switch (postbyte & 0b00001111) {
+		case 0b1000:
+		case 0b1100:
+			return 1;
+		case 0b1001:
+		case 0b1101:
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * Instructions that (may) change the flow of the program end a block.
+ * Decoding past them is harmless, but mostly wasted effort.
+ */
+bool mc6809::ends_block(execute_instruction instruction, addressing_mode mode, uint16_t operand)
+{
+	bool pulls_pc = (operand & 0x80) && ((instruction == &mc6809::puls) || (instruction == &mc6809::pulu));
+
+	return
+		(mode == &mc6809::a_reb) || (mode == &mc6809::a_rew) ||
+		(instruction == &mc6809::jmp)  || (instruction == &mc6809::jsr)  ||
+		(instruction == &mc6809::rts)  || (instruction == &mc6809::rti)  ||
+		pulls_pc ||
+		(instruction == &mc6809::tfr)  || (instruction == &mc6809::exg)  ||
+		(instruction == &mc6809::swi)  || (instruction == &mc6809::swi2) ||
+		(instruction == &mc6809::swi3) || (instruction == &mc6809::sync) ||
+		(instruction == &mc6809::cwai) || (instruction == &mc6809::ill);
+}
+
+void mc6809::decode_block(uint16_t address)
+{
+	uint8_t page = address >> 8;
+
+	decode_page_used[page] = true;
+
+	decoded_instruction_t *block[DECODE_BLOCK_SIZE];
+	int no = 0;
+
+	for (int n=0; n<DECODE_BLOCK_SIZE; n++) {
+		decoded_instruction_t *d = &decode_cache[address];
+
+		if (d->kind != DECODED_NONE) break;	// rest of block is known
+
+		/*
+		 * Work with a 32 bit pc, to catch wrap around at $ffff
+		 */
+		uint32_t p = address;
+
+		uint8_t opcode = read8(p++);
+		execute_instruction instruction = opcodes_page1[opcode];
+		addressing_mode mode = addressing_modes_page1[opcode];
+		uint16_t c = cycles_page1[opcode];
+		uint16_t page_opcode = opcode;
+
+		if ((instruction == &mc6809::page2) || (instruction == &mc6809::page3)) {
+			bool is_page2 = (instruction == &mc6809::page2);
+			if ((p >> 8) != page) {
+				d->kind = DECODED_SLOW;
+				break;
+			}
+			opcode = read8(p++);
+			page_opcode = (is_page2 ? 0x100 : 0x200) | opcode;
+			instruction = is_page2 ? opcodes_page2[opcode] : opcodes_page3[opcode];
+			mode = is_page2 ? addressing_modes_page2[opcode] : addressing_modes_page3[opcode];
+			c += is_page2 ? cycles_page2[opcode] : cycles_page3[opcode];
+		}
+
+		/*
+		 * Number of operand bytes. All bytes of an instruction must be
+		 * on this page: they're read without side effects only there,
+		 * and writes to a next page wouldn't invalidate it.
+		 */
+		int operand_bytes = 0;
+
+		if ((mode == &mc6809::a_imb) || (mode == &mc6809::a_reb) || (mode == &mc6809::a_dir)) {
+			operand_bytes = 1;
+		} else if ((mode == &mc6809::a_imw) || (mode == &mc6809::a_rew) || (mode == &mc6809::a_ext)) {
+			operand_bytes = 2;
+		} else if (mode == &mc6809::a_idx) {
+			if ((p >> 8) != page) {
+				d->kind = DECODED_SLOW;
+				break;
+			}
+			operand_bytes = 1 + indexed_extra_bytes(read8(p));
+		}
+
+		if (((p + operand_bytes - 1) >> 8) != page) {
+			d->kind = DECODED_SLOW;
+			break;
+		}
+
+		uint16_t ea = 0;
+		uint16_t operand = 0;
+		uint8_t kind = DECODED_EA;
+		uint16_t next_pc = p + operand_bytes;
+
+		if ((mode == &mc6809::a_ih) || (mode == &mc6809::a_no)) {
+			// nothing to do
+		} else if (mode == &mc6809::a_imb) {
+			ea = p;
+			operand = read8(p);
+		} else if (mode == &mc6809::a_imw) {
+			ea = p;
+			operand = (read8(p) << 8) | read8(p + 1);
+		} else if (mode == &mc6809::a_reb) {
+			ea = next_pc + (uint16_t)((int8_t)read8(p));
+		} else if (mode == &mc6809::a_rew) {
+			ea = next_pc + ((read8(p) << 8) | read8(p + 1));
+		} else if (mode == &mc6809::a_ext) {
+			ea = (read8(p) << 8) | read8(p + 1);
+		} else if (mode == &mc6809::a_dir) {
+			ea = read8(p);
+			kind = DECODED_DIRECT;
+		} else {
+			/*
+			 * Indexed, postbyte and offsets are read at runtime by
+			 * the addressing mode, starting at pc after the opcode.
+			 */
+			kind = DECODED_DYNAMIC;
+			next_pc = p;
+		}
+
+		d->instruction = instruction;
+		d->mode = mode;
+		d->fused = NULL;
+		d->ea = ea;
+		d->next_pc = next_pc;
+		d->next_instruction = p + operand_bytes;
+		d->cycles = c;
+		d->opcode = page_opcode;
+		d->operand = operand;
+		d->kind = kind;
+
+		/*
+		 * A branch to itself (bra *) only waits for an interrupt,
+		 * unless there's a breakpoint on it that must be hit on
+		 * every pass
+		 */
+		if (((instruction == &mc6809::bra) || (instruction == &mc6809::lbra)) && (ea == address) &&
+		    !breakpoint_array[address]) {
+			d->fused = &mc6809::f_idle_loop;
+		}
+
+		block[no++] = d;
+
+		p += operand_bytes;
+
+		if (ends_block(instruction, mode, operand) || ((p >> 8) != page)) break;
+
+		address = p;
+	}
+
+	if (!pair_profile) fuse_block(block, no);
+}
+
+/*
+ * Superinstructions are recognised per block, last pair first, so that
+ * a pair ending in a branch can be extended into a triple:
+ *
+ * - lda/ldb #imm followed by sta/stb (dir/ext) of the same register
+ * - ldd/ldx/ldy/ldu #imm followed by a store (dir/ext) of the same register
+ * - any instruction followed by a branch (e.g. cmpx #imm / bne)
+ * - any instruction followed by such a pair (e.g. leax 2,x / cmpx / bne)
+ * - pshs/pshu/puls/pulu followed by an instruction or such a pair
+ *   (e.g. pshs x,y / ldx, puls x,y / rts)
+ *
+ * Flags and cycles are exactly those of the individual instructions.
+ */
+void mc6809::fuse_block(decoded_instruction_t **block, int no)
+{
+	for (int i = no - 2; i >= 0; i--) {
+		decoded_instruction_t *d = block[i];
+		decoded_instruction_t *e = block[i + 1];
+
+		if ((d->kind == DECODED_SLOW) || (e->kind == DECODED_SLOW)) continue;
+		if (ends_block(d->instruction, d->mode, d->operand)) continue;
+		if (breakpoint_array[d->next_instruction]) continue;
+
+		bool e_is_store = (e->kind == DECODED_EA) || (e->kind == DECODED_DIRECT);
+		e_is_store = e_is_store && (e->mode != &mc6809::a_reb) && (e->mode != &mc6809::a_rew);
+
+		bool d_is_stack =
+			(d->instruction == &mc6809::pshs) || (d->instruction == &mc6809::pshu) ||
+			(d->instruction == &mc6809::puls) || (d->instruction == &mc6809::pulu);
+
+		/*
+		 * Sequences are no longer than three instructions
+		 */
+		bool e_is_short = (e->fused != &mc6809::f_pair) || (block[i + 2]->fused == NULL);
+
+		if (e_is_store &&
+		    (((d->opcode == 0x86) && (e->instruction == &mc6809::sta)) ||
+		     ((d->opcode == 0xc6) && (e->instruction == &mc6809::stb)))) {
+			d->fused = &mc6809::f_ld8_st8;
+		} else if (e_is_store &&
+		    (((d->opcode == 0x0cc) && (e->instruction == &mc6809::std)) ||
+		     ((d->opcode == 0x08e) && (e->instruction == &mc6809::stx)) ||
+		     ((d->opcode == 0x0ce) && (e->instruction == &mc6809::stu)) ||
+		     ((d->opcode == 0x18e) && (e->instruction == &mc6809::sty)))) {
+			d->fused = &mc6809::f_ld16_st16;
+		} else if ((e->mode == &mc6809::a_reb) || (e->mode == &mc6809::a_rew) ||
+		    (e_is_short && ((e->fused == &mc6809::f_pair) || d_is_stack))) {
+			d->fused = &mc6809::f_pair;
+		}
+	}
+}
+
+void mc6809::f_pair(decoded_instruction_t *d)
+{
+	decoded_instruction_t *e = &decode_cache[d->next_instruction];
+
+	run_decoded(d);
+
+	if (fusion_break(e)) return;
+
+	instruction_start_cycles = cycles;
+	if (e->fused) {
+		(this->*e->fused)(e);
+	} else {
+		run_decoded(e);
+	}
+}
+
+void mc6809::f_ld8_st8(decoded_instruction_t *d)
+{
+	decoded_instruction_t *e = &decode_cache[d->next_instruction];
+	uint8_t value = d->operand;
+
+	if (d->opcode == 0x86) ac = value; else br = value;
+	clear_v_flag();
+	test_nz_flags(value);
+	cycles += d->cycles;
+	pc = d->next_pc;
+
+	if (fusion_break(e)) return;
+
+	/*
+	 * Store sets the same flags
+	 */
+	instruction_start_cycles = cycles;
+	cycles += e->cycles;
+	pc = e->next_pc;
+	write8((e->kind == DECODED_DIRECT) ? ((dp << 8) | e->ea) : e->ea, value);
+}
+
+void mc6809::f_ld16_st16(decoded_instruction_t *d)
+{
+	decoded_instruction_t *e = &decode_cache[d->next_instruction];
+	uint16_t value = d->operand;
+
+	switch (d->opcode) {
+		case 0x0cc: ac = (value & 0xff00) >> 8; br = value & 0xff; break;
+		case 0x08e: xr = value; break;
+		case 0x0ce: us = value; break;
+		default:    yr = value; break;
+	}
+	clear_v_flag();
+	test_nz_flags_16(value);
+	cycles += d->cycles;
+	pc = d->next_pc;
+
+	if (fusion_break(e)) return;
+
+	uint16_t ea = (e->kind == DECODED_DIRECT) ? ((dp << 8) | e->ea) : e->ea;
+	instruction_start_cycles = cycles;
+	cycles += e->cycles;
+	pc = e->next_pc;
+	write8(ea, (value & 0xff00) >> 8);
+	write8((uint16_t)(ea + 1), value & 0xff);
+}
+
+void mc6809::f_idle_loop(decoded_instruction_t *d)
+{
+	cycles += d->cycles * idle_steps(d->cycles);
+	pc = d->ea;
+}
+
+void mc6809::execute_decoded()
+{
+	decoded_instruction_t *d = &decode_cache[pc];
+
+	if (d->kind == DECODED_NONE) decode_block(pc);
+
+	if (d->kind == DECODED_SLOW) {
+		execute_fetched();
+	} else if (d->fused) {
+		(this->*d->fused)(d);
+	} else {
+		if (pair_profile) {
+			pair_profile[(pair_profile_previous * 768) + d->opcode]++;
+			pair_profile_previous = d->opcode;
+		}
+		run_decoded(d);
+	}
+}
+
+void mc6809::set_pair_profile(bool profile)
+{
+	if (profile && !pair_profile) {
+		pair_profile = new uint32_t[768 * 768];
+		for (int i=0; i<(768 * 768); i++) pair_profile[i] = 0;
+		pair_profile_previous = 0;
+	} else if (!profile && pair_profile) {
+		delete [] pair_profile;
+		pair_profile = NULL;
+	}
+
+	/*
+	 * Superinstructions on or off
+	 */
+	flush_decode_cache();
+}
+
+/*
+ * Prints the no most frequent pairs, as in:
+ *
+ *     count  first         second
+ *     12345  86 lda        b7 sta
+ */
+void mc6809::pair_profile_report(char *text_buffer, int n, int no)
+{
+	int bytes = snprintf(text_buffer, n, "     count  first         second");
+	text_buffer += bytes;
+	n -= bytes;
+
+	if (!pair_profile) return;
+
+	uint32_t last_count = 0xffffffff;
+	int last_index = -1;
+
+	for (int i=0; i<no; i++) {
+		/*
+		 * Find next pair in descending order, without sorting
+		 */
+		int index = -1;
+		for (int j=0; j<(768 * 768); j++) {
+			uint32_t c = pair_profile[j];
+			if ((c == 0) || (c > last_count) || ((c == last_count) && (j <= last_index))) continue;
+			if ((index < 0) || (c > pair_profile[index])) index = j;
+		}
+		if (index < 0) break;
+
+		uint16_t first = index / 768;
+		uint16_t second = index % 768;
+		char first_prefix[12] = "";
+		char second_prefix[12] = "";
+		if (first >> 8) snprintf(first_prefix, sizeof(first_prefix), "%02x ", 0x0f + (first >> 8));
+		if (second >> 8) snprintf(second_prefix, sizeof(second_prefix), "%02x ", 0x0f + (second >> 8));
+
+		bytes = snprintf(text_buffer, n, "\n%10u  %s%02x %s   %s%02x %s",
+			pair_profile[index],
+			first_prefix, first & 0xff, opcode_mnemonic(first),
+			second_prefix, second & 0xff, opcode_mnemonic(second));
+		text_buffer += bytes;
+		n -= bytes;
+
+		last_count = pair_profile[index];
+		last_index = index;
+	}
+}
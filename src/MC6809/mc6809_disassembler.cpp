@@ -784,3 +784,12 @@ uint16_t mc6809::disassemble_instruction(char *buffer, size_t n, uint16_t addres
 	original_buffer[16] = ' ';
 	return address - start_address;
 }
+
+const char *mc6809::opcode_mnemonic(uint16_t opcode)
+{
+	switch (opcode >> 8) {
+		case 0:  return mnemonics[opcodes_page_1[opcode & 0xff]];
+		case 1:  return mnemonics[opcodes_page_2[opcode & 0xff]];
+		default: return mnemonics[opcodes_page_3[opcode & 0xff]];
+	}
+}
@@ -7,16 +7,6 @@
 #include "mc6809.hpp"
 #include <cstdio>
 
-uint8_t  byte;
-uint16_t word;
-uint32_t dword;
-
-/*
- * d_reg is a stand-in temporary variable to ease calculations
- * during individual instructions that deal with the d register
- */
-uint16_t d_reg;
-
 void mc6809::ill(uint16_t ea)
 {
 	// TODO !!!!!
@@ -559,7 +549,25 @@ void mc6809::comb(uint16_t ea)
 
 void mc6809::cwai(uint16_t ea)
 {
-	//
+	/*
+	 * And cc with immediate byte, stack entire state and wait for
+	 * an interrupt (see execute())
+	 */
+	cc &= read8(ea);
+	set_e_flag();
+	push_sp(pc & 0x00ff);
+	push_sp((pc & 0xff00) >> 8);
+	push_sp(us & 0x00ff);
+	push_sp((us & 0xff00) >> 8);
+	push_sp(yr & 0x00ff);
+	push_sp((yr & 0xff00) >> 8);
+	push_sp(xr & 0x00ff);
+	push_sp((xr & 0xff00) >> 8);
+	push_sp(dp);
+	push_sp(br);
+	push_sp(ac);
+	push_sp(cc);
+	cpu_state = CPU_CWAI;
 }
 
 void mc6809::daa(uint16_t ea)
@@ -31,53 +31,89 @@ const uint16_t music_notes[256] = {
 	0,0,0,0,0,0,0,0
 };
 
-analog_ic::analog_ic(uint8_t no)
-{
-	id = no;
-	
-	sinus_amplitude = new double[TABLE_SIZE];
-	triangle_amplitude = new double[TABLE_SIZE];
-	sawtooth_amplitude = new double[TABLE_SIZE];
-	
-	exponential_increase = new double[TABLE_SIZE];
-	exponential_decrease = new double[TABLE_SIZE];
-	
-	printf("[Analog%u] Creating wave lookup tables\n", id);
-	for (int i=0; i<TABLE_SIZE; i++) {
-		/*
-		 * Using SAMPLE_RATE * MAX_WAVELENGTH no. of samples for
-		 * lookup table.
-		 */
-		
-		/* Sinus */
-		sinus_amplitude[i] = sin(2*M_PI*((double)i / TABLE_SIZE));
-		
-		/* Triangle */
-		if (i < (TABLE_SIZE / 4)) {
-			triangle_amplitude[i] = (double)i / (TABLE_SIZE / 4);
-		} else if (i < (3 * (TABLE_SIZE / 4))) {
-			triangle_amplitude[i] = 2.0 - ((double)i / (TABLE_SIZE / 4));
-		} else {
-			triangle_amplitude[i] = -4.0 + ((double)i / (TABLE_SIZE / 4));
+/*
+ * Lookup tables are computed once, on first use (thread safe static
+ * initialization), and then shared read-only by all analog voices of
+ * all machine instances. Tables have one extra entry at the end to
+ * allow interpolation without bounds checks.
+ */
+struct analog_tables_t {
+	float sinus_amplitude[ANALOG_TABLE_SIZE + 1];
+	float exponential_increase[ANALOG_TABLE_SIZE + 1];
+	double pitch_equal_tempered_scale[256];
+
+	analog_tables_t() {
+		printf("[Analog] Creating shared wave lookup tables\n");
+		for (int i=0; i<=ANALOG_TABLE_SIZE; i++) {
+			sinus_amplitude[i] = sin(2*M_PI*((double)i / ANALOG_TABLE_SIZE));
+			exponential_increase[i] = pow((double)i / ANALOG_TABLE_SIZE, STEEPNESS);
 		}
-		
-		/* Sawtooth */
-		if (i < (TABLE_SIZE / 2)) {
-			sawtooth_amplitude[i] = (double)i / (TABLE_SIZE / 2);
-		} else {
-			sawtooth_amplitude[i] = -1.0 + ((double)(i - (TABLE_SIZE / 2)) / (TABLE_SIZE / 2));
+		for (int i=0; i<256; i++) {
+			pitch_equal_tempered_scale[i] = pow(2.0, (double)i / 12);
 		}
-		
-		/*
-		 * Envelopes
-		 */
-		exponential_increase[i] = pow((double)i / (TABLE_SIZE - 1), STEEPNESS);
-		exponential_decrease[(TABLE_SIZE - 1) - i] = exponential_increase[i];
+	}
+};
+
+static const analog_tables_t *shared_tables()
+{
+	static const analog_tables_t tables;
+	return &tables;
+}
+
+static inline double interpolate(const float *table, double position)
+{
+	uint32_t i = (uint32_t)position;
+	if (i >= ANALOG_TABLE_SIZE) return table[ANALOG_TABLE_SIZE];
+	double fraction = position - i;
+	return table[i] + (fraction * (table[i + 1] - table[i]));
+}
+
+inline double analog_ic::sinus_amplitude(uint32_t phase)
+{
+	return interpolate(tables->sinus_amplitude, phase * ((double)ANALOG_TABLE_SIZE / TABLE_SIZE));
+}
 
-		
-		//printf("%i:\tsin %lf\ttri %lf\tsaw %lf\texpinc %lf\n", i, sinus_amplitude[i], triangle_amplitude[i], sawtooth_amplitude[i], exponential_increase[i]);
+inline double analog_ic::triangle_amplitude(uint32_t phase)
+{
+	if (phase < (TABLE_SIZE / 4)) {
+		return (double)phase / (TABLE_SIZE / 4);
+	} else if (phase < (3 * (TABLE_SIZE / 4))) {
+		return 2.0 - ((double)phase / (TABLE_SIZE / 4));
+	} else {
+		return -4.0 + ((double)phase / (TABLE_SIZE / 4));
 	}
-	
+}
+
+inline double analog_ic::sawtooth_amplitude(uint32_t phase)
+{
+	if (phase < (TABLE_SIZE / 2)) {
+		return (double)phase / (TABLE_SIZE / 2);
+	} else {
+		return -1.0 + ((double)(phase - (TABLE_SIZE / 2)) / (TABLE_SIZE / 2));
+	}
+}
+
+inline double analog_ic::exponential_increase(int32_t phase)
+{
+	/*
+	 * Clamped, at the end of a stage phase may equal TABLE_SIZE
+	 */
+	if (phase < 0) phase = 0;
+	if (phase > TABLE_SIZE - 1) phase = TABLE_SIZE - 1;
+	return interpolate(tables->exponential_increase, phase * ((double)ANALOG_TABLE_SIZE / (TABLE_SIZE - 1)));
+}
+
+inline double analog_ic::exponential_decrease(int32_t phase)
+{
+	return exponential_increase((TABLE_SIZE - 1) - phase);
+}
+
+analog_ic::analog_ic(uint8_t no)
+{
+	id = no;
+
+	tables = shared_tables();
+
 	gate_open = false;
 	envelope_stage = OFF;
 	phase = 0;
@@ -92,11 +128,6 @@ analog_ic::analog_ic(uint8_t no)
 	pitch_factor = 36;		// 3 octaves = 8x higher
 	pitch_bend_duration = 256;
 	
-	for (int i=0; i<256; i++) {
-		pitch_equal_tempered_scale[i] = pow(2.0, (double)i / 12);
-		//printf("%d, %f\n", i, pitch_tempered_scale[i]);
-	}
-	
 	attack	= 2;		// 0.2 ms (not 2)
 	decay	= 384;		// 384 ms
 	sustain	= 0x0000;	// level
@@ -105,12 +136,6 @@ analog_ic::analog_ic(uint8_t no)
 
 analog_ic::~analog_ic()
 {
-	delete [] exponential_decrease;
-	delete [] exponential_increase;
-	
-	delete [] sawtooth_amplitude;
-	delete [] triangle_amplitude;
-	delete [] sinus_amplitude;
 }
 
 uint8_t analog_ic::read_byte(uint8_t address)
@@ -226,175 +251,325 @@ void analog_ic::run(uint16_t no_samples, int16_t *buffer)
 	 * Calculate things that remain the same during this run
 	 */
 	uint32_t duty = ((double)square_duty/65535) * TABLE_SIZE;
-	
-	
-	uint16_t no_samples_temp = no_samples;
-	
-	while (no_samples_temp--) {
+
+	float envelope_values[ANALOG_BLOCK_SIZE];
+	int16_t raw[ANALOG_BLOCK_SIZE];
+
+	while (no_samples) {
+		uint16_t n = (no_samples < ANALOG_BLOCK_SIZE) ? no_samples : ANALOG_BLOCK_SIZE;
+		bool generate;
+
 		/*
-		 * volume envelope
+		 * Envelope decides how many samples belong together in
+		 * this segment (within one stage, no stage changes)
 		 */
-		switch (envelope_stage) {
-			case OFF:
+		n = envelope_block(n, envelope_values, &generate);
+
+		if (generate) {
+			oscillator_block(n, duty, raw);
+			for (int i=0; i<n; i++) {
+				/*
+				 * Envelope is applied twice (a squared
+				 * envelope), truncating like the original
+				 * 16 bit integer samples
+				 */
+				int32_t sample = (int32_t)(raw[i] * envelope_values[i]);
+				buffer[i] = (int32_t)(sample * envelope_values[i]);
+			}
+		} else {
+			// quiet
+			for (int i=0; i<n; i++) {
+				buffer[i] = 0;
+			}
+		}
+
+		buffer += n;
+		no_samples -= n;
+	}
+}
+
+/*
+ * Bresenham style advance of an envelope phase from 0 to TABLE_SIZE in
+ * a given number of samples. Equivalent to:
+ *
+ * phase += (TABLE_SIZE + delta) / samples;
+ * delta  = (TABLE_SIZE + delta) % samples;
+ */
+static inline void advance(uint32_t &phase, uint32_t &delta, uint32_t quotient, uint32_t remainder, uint32_t samples)
+{
+	phase += quotient;
+	delta += remainder;
+	if (delta >= samples) {
+		delta -= samples;
+		phase++;
+	}
+}
+
+uint16_t analog_ic::envelope_block(uint16_t n, float *values, bool *generate)
+{
+	/*
+	 * Only samples that don't change the envelope stage are done in
+	 * a block. Gate is constant during a run, so stage changes only
+	 * happen at the start of a run or at the end of a timed stage.
+	 */
+	uint16_t k = 0;
+
+	switch (envelope_stage) {
+		case OFF:
+			if (!gate_open) {
+				k = n;
 				envelope = 0.0;
+			}
+			break;
+		case SUSTAIN:
+			if (gate_open) {
+				k = n;
+				envelope = (double)sustain / 65535.0;
+			}
+			break;
+		case ATTACK:
+		case DECAY:
+			if (gate_open && (stage_samples_remaining > 1)) {
+				if (stage_samples_remaining - 1 < n) n = stage_samples_remaining - 1;
+				k = n;
+			}
+			break;
+		case RELEASE:
+			if (!gate_open && (stage_samples_remaining > 1)) {
+				if (stage_samples_remaining - 1 < n) n = stage_samples_remaining - 1;
+				k = n;
+			}
+			break;
+	}
 
-				if (gate_open) {
-					envelope_stage = ATTACK;
-					phase = phase_delta = 0;
-					envelope_target = 1.0;
-					envelope_change = envelope_target;
-					envelope_phase = envelope_phase_delta = 0;
-					stage_samples = stage_samples_remaining =
-						((SAMPLE_RATE * attack) / 10000) + 1;
-					//printf("Attack: %0.1f ms --> %u samples\n", (double)attack/10, stage_samples);
-					
-					pitch_bend_reset();
-				}
-				break;
-			case ATTACK:
-				if (gate_open) {
-					stage_samples_remaining--;
-					
-					envelope_phase += (TABLE_SIZE + envelope_phase_delta) / stage_samples;
-					envelope_phase_delta = (TABLE_SIZE + envelope_phase_delta) % stage_samples;
-					
-					//printf("%u\n", envelope_phase);
-					
-					envelope = exponential_increase[envelope_phase - 1] * envelope_change;
-					
-					if (stage_samples_remaining == 0) {
-						envelope = 1.0;
-						envelope_stage = DECAY;
-						envelope_target = (double)sustain / 0xffff;
-						envelope_change = envelope - envelope_target;
-						envelope_phase = envelope_phase_delta = 0;
-						stage_samples = stage_samples_remaining
-							= ((SAMPLE_RATE * decay) / 1000) + 1;
-						//printf("Decay: %u ms --> %u samples\n", decay, stage_samples);
-					}
-				} else {
-					envelope_stage = RELEASE;
-					envelope_target = 0.0;
-					envelope_change = envelope;
-					envelope_phase = envelope_phase_delta = 0;
-					stage_samples = stage_samples_remaining =
-						((SAMPLE_RATE * release) / 1000) + 1;
-					//printf("Release: %u ms --> %u samples\n", release, stage_samples);
-				}
-				break;
-			case DECAY:
-				//envelope = 1.0;
+	if (k == 0) {
+		/*
+		 * A single sample with a stage change
+		 */
+		*generate = envelope_step();
+		values[0] = envelope;
+		return 1;
+	}
+
+	*generate = (envelope_stage != OFF);
+
+	if ((envelope_stage == OFF) || (envelope_stage == SUSTAIN)) {
+		for (int i=0; i<k; i++) {
+			values[i] = envelope;
+		}
+		return k;
+	}
+
+	uint32_t quotient = TABLE_SIZE / stage_samples;
+	uint32_t remainder = TABLE_SIZE % stage_samples;
+
+	switch (envelope_stage) {
+		case ATTACK:
+			for (int i=0; i<k; i++) {
+				advance(envelope_phase, envelope_phase_delta, quotient, remainder, stage_samples);
+				values[i] = exponential_increase(envelope_phase - 1) * envelope_change;
+			}
+			break;
+		case DECAY:
+			for (int i=0; i<k; i++) {
+				advance(envelope_phase, envelope_phase_delta, quotient, remainder, stage_samples);
+				values[i] = envelope_target + (exponential_decrease(envelope_phase) * envelope_change);
+			}
+			break;
+		case RELEASE:
+			for (int i=0; i<k; i++) {
+				advance(envelope_phase, envelope_phase_delta, quotient, remainder, stage_samples);
+				values[i] = exponential_decrease(envelope_phase) * envelope_change;
+			}
+			break;
+		default:
+			break;
+	}
+
+	stage_samples_remaining -= k;
+	envelope = values[k - 1];
+
+	return k;
+}
+
+bool analog_ic::envelope_step()
+{
+	switch (envelope_stage) {
+		case OFF:
+			envelope = 0.0;
+
+			if (gate_open) {
+				envelope_stage = ATTACK;
+				phase = phase_delta = 0;
+				envelope_target = 1.0;
+				envelope_change = envelope_target;
+				envelope_phase = envelope_phase_delta = 0;
+				stage_samples = stage_samples_remaining =
+					((SAMPLE_RATE * attack) / 10000) + 1;
+				//printf("Attack: %0.1f ms --> %u samples\n", (double)attack/10, stage_samples);
+				
+				pitch_bend_reset();
+			}
+			break;
+		case ATTACK:
+			if (gate_open) {
 				stage_samples_remaining--;
 				
 				envelope_phase += (TABLE_SIZE + envelope_phase_delta) / stage_samples;
 				envelope_phase_delta = (TABLE_SIZE + envelope_phase_delta) % stage_samples;
 				
-				envelope = envelope_target + (exponential_decrease[envelope_phase] * envelope_change);
+				//printf("%u\n", envelope_phase);
 				
-				if (gate_open) {
-					//stage_samples--;
-					if (stage_samples_remaining == 0) {
-						envelope_stage = SUSTAIN;
-						// target ....
-						//printf("Sustain at: %u\n", sustain);
-					}
-				} else {
-					envelope_stage = RELEASE;
-					envelope_target = 0.0;
-					envelope_change = envelope;
-					envelope_phase = envelope_phase_delta = 0;
-					stage_samples = stage_samples_remaining =
-						((SAMPLE_RATE * release) / 1000) + 1;
-					//printf("Release: %u ms --> %u samples\n", release, stage_samples);
-				}
-				break;
-			case SUSTAIN:
-				envelope = (double)sustain / 65535.0;
+				envelope = exponential_increase(envelope_phase - 1) * envelope_change;
 				
-				if (gate_open) {
-					// don't change anything
-				} else {
-					envelope_stage = RELEASE;
-					envelope_target = 0.0;
-					envelope_change = envelope;
+				if (stage_samples_remaining == 0) {
+					envelope = 1.0;
+					envelope_stage = DECAY;
+					envelope_target = (double)sustain / 0xffff;
+					envelope_change = envelope - envelope_target;
 					envelope_phase = envelope_phase_delta = 0;
-					stage_samples = stage_samples_remaining =
-						((SAMPLE_RATE * release) / 1000) + 1;
-					//printf("Release: %u ms --> %u samples\n", release, stage_samples);
+					stage_samples = stage_samples_remaining
+						= ((SAMPLE_RATE * decay) / 1000) + 1;
+					//printf("Decay: %u ms --> %u samples\n", decay, stage_samples);
 				}
-				break;
-			case RELEASE:
-				stage_samples_remaining--;
-				
-				envelope_phase += (TABLE_SIZE + envelope_phase_delta) / stage_samples;
-				envelope_phase_delta = (TABLE_SIZE + envelope_phase_delta) % stage_samples;
-				
-				envelope = exponential_decrease[envelope_phase] * envelope_change;
-				
-				if (gate_open) {
-					envelope_stage = ATTACK;
-					phase = phase_delta = 0;
-					envelope_target = 1.0;
-					envelope_change = envelope_target - envelope;
-					envelope_phase = envelope_phase_delta = 0;
-					stage_samples = stage_samples_remaining =
-						((SAMPLE_RATE * attack) / 10000) + 1;
-					//printf("Attack: %0.1f ms --> %u samples\n", (double)attack/10, stage_samples);
-					
-					pitch_bend_reset();
-				} else {
-					if (stage_samples_remaining == 0) {
-						envelope_stage = OFF;
-						// envelope target = 0.0 ....
-						//printf("Quiet\n");
-					}
+			} else {
+				envelope_stage = RELEASE;
+				envelope_target = 0.0;
+				envelope_change = envelope;
+				envelope_phase = envelope_phase_delta = 0;
+				stage_samples = stage_samples_remaining =
+					((SAMPLE_RATE * release) / 1000) + 1;
+				//printf("Release: %u ms --> %u samples\n", release, stage_samples);
+			}
+			break;
+		case DECAY:
+			//envelope = 1.0;
+			stage_samples_remaining--;
+			
+			envelope_phase += (TABLE_SIZE + envelope_phase_delta) / stage_samples;
+			envelope_phase_delta = (TABLE_SIZE + envelope_phase_delta) % stage_samples;
+			
+			envelope = envelope_target + (exponential_decrease(envelope_phase) * envelope_change);
+			
+			if (gate_open) {
+				//stage_samples--;
+				if (stage_samples_remaining == 0) {
+					envelope_stage = SUSTAIN;
+					// target ....
+					//printf("Sustain at: %u\n", sustain);
 				}
-				break;
-		}
-		
-		/*
-		 * Generate current sample
-		 */
-		if (envelope_stage != OFF) {
-
-			switch (waveform) {
-				case SINE:
-					*buffer = 32767 * sinus_amplitude[phase];
-					break;
-				case SQUARE:
-					(phase < duty) ? *buffer = 32767 : *buffer = -32767;
-					break;
-				case TRIANGLE:
-					*buffer = 32767 * triangle_amplitude[phase];
-					break;
-				case SAWTOOTH:
-					*buffer = 32767 * sawtooth_amplitude[phase];
-				case NOISE:
-					*buffer = (int16_t)((uniform_white_noise.byte() << 8) | uniform_white_noise.byte());
-					break;
-				default:
-					*buffer = 0;
-					break;
+			} else {
+				envelope_stage = RELEASE;
+				envelope_target = 0.0;
+				envelope_change = envelope;
+				envelope_phase = envelope_phase_delta = 0;
+				stage_samples = stage_samples_remaining =
+					((SAMPLE_RATE * release) / 1000) + 1;
+				//printf("Release: %u ms --> %u samples\n", release, stage_samples);
 			}
+			break;
+		case SUSTAIN:
+			envelope = (double)sustain / 65535.0;
 			
-			*buffer *= envelope;
+			if (gate_open) {
+				// don't change anything
+			} else {
+				envelope_stage = RELEASE;
+				envelope_target = 0.0;
+				envelope_change = envelope;
+				envelope_phase = envelope_phase_delta = 0;
+				stage_samples = stage_samples_remaining =
+					((SAMPLE_RATE * release) / 1000) + 1;
+				//printf("Release: %u ms --> %u samples\n", release, stage_samples);
+			}
+			break;
+		case RELEASE:
+			stage_samples_remaining--;
 			
-			set_frequency();
-			frequency *= pitch_bend();
-
-			_frequency = frequency + (phase_remainder / MAX_WAVELENGTH);
-			phase_delta = _frequency * MAX_WAVELENGTH;
-			phase += phase_delta;
-			phase %= TABLE_SIZE;
-			phase_remainder = (MAX_WAVELENGTH * _frequency) - phase_delta;
+			envelope_phase += (TABLE_SIZE + envelope_phase_delta) / stage_samples;
+			envelope_phase_delta = (TABLE_SIZE + envelope_phase_delta) % stage_samples;
 			
-		} else {
-			// quiet
-			*buffer = 0;
-		}
-		
-		*buffer *= envelope;
-		buffer++;
+			envelope = exponential_decrease(envelope_phase) * envelope_change;
+			
+			if (gate_open) {
+				envelope_stage = ATTACK;
+				phase = phase_delta = 0;
+				envelope_target = 1.0;
+				envelope_change = envelope_target - envelope;
+				envelope_phase = envelope_phase_delta = 0;
+				stage_samples = stage_samples_remaining =
+					((SAMPLE_RATE * attack) / 10000) + 1;
+				//printf("Attack: %0.1f ms --> %u samples\n", (double)attack/10, stage_samples);
+				
+				pitch_bend_reset();
+			} else {
+				if (stage_samples_remaining == 0) {
+					envelope_stage = OFF;
+					// envelope target = 0.0 ....
+					//printf("Quiet\n");
+				}
+			}
+			break;
+	}
+	
+	return envelope_stage != OFF;
+}
+
+inline void analog_ic::advance_phase()
+{
+	_frequency = frequency + (phase_remainder / MAX_WAVELENGTH);
+	phase_delta = _frequency * MAX_WAVELENGTH;
+	phase += phase_delta;
+	phase %= TABLE_SIZE;
+	phase_remainder = (MAX_WAVELENGTH * _frequency) - phase_delta;
+}
+
+void analog_ic::oscillator_block(uint16_t n, uint32_t duty, int16_t *raw)
+{
+	uint32_t phases[ANALOG_BLOCK_SIZE];
+	double factors[ANALOG_BLOCK_SIZE];
+
+	/*
+	 * Phase accumulation (serial). Frequency only changes from sample
+	 * to sample while a pitch bend is in progress.
+	 */
+	set_frequency();
+	double base_frequency = frequency;
+	uint16_t bending = pitch_bend_block(n, factors);
+
+	for (int i=0; i<bending; i++) {
+		phases[i] = phase;
+		frequency = base_frequency * factors[i];
+		advance_phase();
+	}
+	if (bending < n) frequency = base_frequency;
+	for (int i=bending; i<n; i++) {
+		phases[i] = phase;
+		advance_phase();
+	}
+
+	/*
+	 * Waveform, one loop per type
+	 */
+	switch (waveform) {
+		case SINE:
+			for (int i=0; i<n; i++) raw[i] = 32767 * sinus_amplitude(phases[i]);
+			break;
+		case SQUARE:
+			for (int i=0; i<n; i++) raw[i] = (phases[i] < duty) ? 32767 : -32767;
+			break;
+		case TRIANGLE:
+			for (int i=0; i<n; i++) raw[i] = 32767 * triangle_amplitude(phases[i]);
+			break;
+		case SAWTOOTH:
+			for (int i=0; i<n; i++) raw[i] = 32767 * sawtooth_amplitude(phases[i]);
+			break;
+		case NOISE:
+			for (int i=0; i<n; i++) raw[i] = (int16_t)((uniform_white_noise.byte() << 8) | uniform_white_noise.byte());
+			break;
+		default:
+			for (int i=0; i<n; i++) raw[i] = 0;
+			break;
 	}
 }
 
@@ -411,24 +586,103 @@ void analog_ic::pitch_bend_reset()
 	pitch_bend_phase = pitch_bend_phase_delta = 0;
 }
 
-double analog_ic::pitch_bend()
+/*
+ * Pitch bend factors for the first samples of a block, returns the
+ * number of samples that are still bending
+ */
+uint16_t analog_ic::pitch_bend_block(uint16_t n, double *factors)
 {
-	if (pitch_samples_remaining) {
-		pitch_samples_remaining--;
-		pitch_bend_phase += (TABLE_SIZE + pitch_bend_phase_delta) / pitch_samples;
-		pitch_bend_phase_delta = (TABLE_SIZE + pitch_bend_phase_delta) % pitch_samples;
-		
-		double result =
-			(exponential_decrease[pitch_bend_phase] *
-			(pitch_equal_tempered_scale[pitch_factor] - 1.0)) + 1.0;
-		
+	uint16_t bending = (n < pitch_samples_remaining) ? n : pitch_samples_remaining;
+	if (!bending) return 0;
+
+	uint32_t quotient = TABLE_SIZE / pitch_samples;
+	uint32_t remainder = TABLE_SIZE % pitch_samples;
+	double scale = tables->pitch_equal_tempered_scale[pitch_factor] - 1.0;
+
+	for (int i=0; i<bending; i++) {
+		advance(pitch_bend_phase, pitch_bend_phase_delta, quotient, remainder, pitch_samples);
 		if (pitch_bend_on) {
-			if (pitch_up) {
-				return 1.0 / result;
-			} else {
-				return result;
-			}
+			double result = (exponential_decrease(pitch_bend_phase) * scale) + 1.0;
+			factors[i] = pitch_up ? (1.0 / result) : result;
+		} else {
+			factors[i] = 1.0;
 		}
 	}
-	return 1.0;
+	pitch_samples_remaining -= bending;
+
+	return bending;
+}
+
+void analog_ic::save_state(state_t *s)
+{
+	s->put(old_buffer);
+	s->put(gate_open);
+	s->put(phase);
+	s->put(phase_delta);
+	s->put(phase_remainder);
+	s->put(frequency);
+	s->put(_frequency);
+	s->put(waveform);
+	s->put(square_duty);
+	s->put(digital_freq);
+	s->put(envelope_stage);
+	s->put(envelope);
+	s->put(envelope_target);
+	s->put(stage_samples);
+	s->put(stage_samples_remaining);
+	s->put(envelope_phase);
+	s->put(envelope_phase_delta);
+	s->put(envelope_change);
+	s->put(attack);
+	s->put(decay);
+	s->put(sustain);
+	s->put(release);
+	s->put(pitch_bend_duration);
+	s->put(pitch_bend_on);
+	s->put(pitch_up);
+	s->put(pitch_factor);
+	s->put(pitch_samples);
+	s->put(pitch_samples_remaining);
+	s->put(pitch_bend_phase);
+	s->put(pitch_bend_phase_delta);
+	s->put(midi_value);
+	s->put(uniform_white_noise.status());
+}
+
+void analog_ic::load_state(state_t *s)
+{
+	s->get(old_buffer);
+	s->get(gate_open);
+	s->get(phase);
+	s->get(phase_delta);
+	s->get(phase_remainder);
+	s->get(frequency);
+	s->get(_frequency);
+	s->get(waveform);
+	s->get(square_duty);
+	s->get(digital_freq);
+	s->get(envelope_stage);
+	s->get(envelope);
+	s->get(envelope_target);
+	s->get(stage_samples);
+	s->get(stage_samples_remaining);
+	s->get(envelope_phase);
+	s->get(envelope_phase_delta);
+	s->get(envelope_change);
+	s->get(attack);
+	s->get(decay);
+	s->get(sustain);
+	s->get(release);
+	s->get(pitch_bend_duration);
+	s->get(pitch_bend_on);
+	s->get(pitch_up);
+	s->get(pitch_factor);
+	s->get(pitch_samples);
+	s->get(pitch_samples_remaining);
+	s->get(pitch_bend_phase);
+	s->get(pitch_bend_phase_delta);
+	s->get(midi_value);
+	uint32_t noise;
+	s->get(noise);
+	uniform_white_noise = rca(noise);
 }
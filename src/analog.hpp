@@ -37,6 +37,7 @@
 
 #include <cstdint>
 #include "rca.hpp"
+#include "state.hpp"
 
 /*
  * Maximum wavelength (in seconds) at full resolution. This results in
@@ -54,6 +55,17 @@
  */
 #define STEEPNESS	4
 
+/*
+ * Resolution of the shared lookup tables (sine and envelope curve).
+ * Values in between are linearly interpolated.
+ */
+#define ANALOG_TABLE_SIZE	4096
+
+/*
+ * Maximum number of samples processed as one block
+ */
+#define ANALOG_BLOCK_SIZE	256
+
 enum waveforms {
 	SINE = 0,
 	TRIANGLE,
@@ -70,24 +82,32 @@ enum envelope_stages {
 	RELEASE
 };
 
+struct analog_tables_t;
+
 class analog_ic {
 private:
 	uint8_t id;
 
 	int16_t old_buffer;
+
+	/*
+	 * Read-only lookup tables, shared by all voices of all machines
+	 */
+	const analog_tables_t *tables;
+
 	/*
-	 * Basic waveforms
+	 * Basic waveforms, phase runs from 0 to TABLE_SIZE - 1
 	 */
-	double *sinus_amplitude;
-	double *triangle_amplitude;
-	double *sawtooth_amplitude;
+	inline double sinus_amplitude(uint32_t phase);
+	inline double triangle_amplitude(uint32_t phase);
+	inline double sawtooth_amplitude(uint32_t phase);
 	// how to do noise?
 
 	/*
-	 * Envelopes
+	 * Envelopes, phase runs from 0 to TABLE_SIZE - 1
 	 */
-	double *exponential_increase;
-	double *exponential_decrease;
+	inline double exponential_increase(int32_t phase);
+	inline double exponential_decrease(int32_t phase);
 
 	bool gate_open;
 
@@ -97,6 +117,7 @@ private:
 
 	double	frequency, _frequency;
 	void 	set_frequency();		// translates digital frequency to real frequency
+	inline void advance_phase();		// one sample at current frequency
 
 	enum waveforms waveform;
 
@@ -129,7 +150,6 @@ private:
 
 	uint8_t  pitch_factor;		// uses only bits 0-6 (and transposed +1
 					// so values 1-128
-	double   pitch_equal_tempered_scale[256];
 
 	uint32_t pitch_samples;
 	uint32_t pitch_samples_remaining;
@@ -138,7 +158,11 @@ private:
 	uint32_t pitch_bend_phase_delta;
 
 	void     pitch_bend_reset();
-	double   pitch_bend();
+	uint16_t pitch_bend_block(uint16_t n, double *factors);
+
+	bool     envelope_step();
+	uint16_t envelope_block(uint16_t n, float *values, bool *generate);
+	void     oscillator_block(uint16_t n, uint32_t duty, int16_t *raw);
 
 	rca	uniform_white_noise;
 	
@@ -154,6 +178,9 @@ public:
 
 	inline void set_digital_frequency(uint16_t f) { digital_freq = f; set_frequency(); }
 	inline uint16_t get_digital_frequency() { return digital_freq; }
+
+	void save_state(state_t *s);
+	void load_state(state_t *s);
 };
 
 #endif
@@ -9,22 +9,132 @@
 #include "common.hpp"
 #include <cstdio>
 #include <cmath>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static inline uint8_t reset_pattern(uint32_t i)
+{
+	return (i & 0x40) ? 0xfc : 0x00;
+}
+
+/*
+ * Anonymous shared memory holding VRAM_PATTERN_SIZE bytes of the reset
+ * pattern, created once and shared by all blitters. Returns -1 when it
+ * can't be created, vram is then filled the ordinary way.
+ */
+static int create_pattern_block()
+{
+#if defined(__linux)
+	int fd = memfd_create("punch_vram", MFD_CLOEXEC);
+#else
+	char name[32];
+	snprintf(name, sizeof(name), "/punch_vram_%i", (int)getpid());
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd >= 0) shm_unlink(name);
+#endif
+	if (fd < 0) return -1;
+
+	if (ftruncate(fd, VRAM_PATTERN_SIZE) == 0) {
+		uint8_t *block = (uint8_t *)mmap(nullptr, VRAM_PATTERN_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (block != MAP_FAILED) {
+			for (uint32_t i=0; i<VRAM_PATTERN_SIZE; i++) block[i] = reset_pattern(i);
+			munmap(block, VRAM_PATTERN_SIZE);
+			return fd;
+		}
+	}
+	close(fd);
+	return -1;
+}
+
+uint8_t *blitter_ic::allocate_vram()
+{
+	void *v = mmap(nullptr, VRAM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (v == MAP_FAILED) throw std::bad_alloc();
+	reset_vram((uint8_t *)v);
+	return (uint8_t *)v;
+}
+
+void blitter_ic::free_vram(uint8_t *v)
+{
+	munmap(v, VRAM_SIZE);
+}
+
+void blitter_ic::reset_vram(uint8_t *v)
+{
+	// machines can be constructed on several threads at once
+	static const int pattern_fd = create_pattern_block();
+
+	for (uint32_t i=0; i<VRAM_SIZE; i+=VRAM_PATTERN_SIZE) {
+		if ((pattern_fd >= 0) &&
+		    (mmap(&v[i], VRAM_PATTERN_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, pattern_fd, 0) != MAP_FAILED)) continue;
+
+		/*
+		 * A failed fixed mapping may leave a hole, make sure the
+		 * chunk is backed before filling it
+		 */
+		if ((pattern_fd >= 0) &&
+		    (mmap(&v[i], VRAM_PATTERN_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0) == MAP_FAILED)) {
+			throw std::bad_alloc();
+		}
+		for (uint32_t j=i; j<i+VRAM_PATTERN_SIZE; j++) v[j] = reset_pattern(j);
+	}
+}
 
 blitter_ic::blitter_ic()
 {
-	vram = new uint8_t[VRAM_SIZE];
+	vram = allocate_vram();
+	mark_all_dirty();
 }
 
 blitter_ic::~blitter_ic()
 {
-	delete [] vram;
+	free_vram(vram);
+}
+
+void blitter_ic::save_state(state_t *s)
+{
+	s->put(src_surface);
+	s->put(dst_surface);
+	s->put(tile_surface);
+	s->put(draw_color);
+	s->put(x0);
+	s->put(y0);
+	s->put(x1);
+	s->put(y1);
+	s->put(alpha);
+	s->put(gamma_red);
+	s->put(gamma_green);
+	s->put(gamma_blue);
+	s->put(vram_peek);
+	s->put(pixel_saldo);
+	s->put_bytes(surface, sizeof(surface));
+}
+
+void blitter_ic::load_state(state_t *s)
+{
+	s->get(src_surface);
+	s->get(dst_surface);
+	s->get(tile_surface);
+	s->get(draw_color);
+	s->get(x0);
+	s->get(y0);
+	s->get(x1);
+	s->get(y1);
+	s->get(alpha);
+	s->get(gamma_red);
+	s->get(gamma_green);
+	s->get(gamma_blue);
+	s->get(vram_peek);
+	s->get(pixel_saldo);
+	s->get_bytes(surface, sizeof(surface));
 }
 
 void blitter_ic::reset()
 {
-	for (int i = 0; i < VRAM_SIZE; i++) {
-		vram[i] = (i & 0x40) ? 0xfc : 0x00;
-	}
+	reset_vram(vram);
+	mark_all_dirty();
 
 	// -----------------------------------------------------------------
 	// A palette using RRGGBBII system. R, G and B use two bits and have
@@ -129,7 +239,7 @@ uint32_t blitter_ic::blit(const surface_t *src, surface_t *dest)
 	}
 
 	// Pixel selector from vram or font + offset + mask selector
-	uint8_t *memory;		// memory is start of an array to 8 bit color numbers
+	const uint8_t *memory;	// memory is start of an array to 8 bit color numbers
 	uint32_t memory_mask;	// mask used when referring to this memory
 	uint32_t start_address;
 
@@ -171,6 +281,14 @@ uint32_t blitter_ic::blit(const surface_t *src, surface_t *dest)
 	// -----------------------------------------------------------------
 	uint8_t color_mode = (src->flags_0 & 0b01110000) >> 4;
 
+	/*
+	 * Destination rows touched (x and y swap with an xy flip)
+	 */
+	if ((startx < endx) && (starty < endy) && pixel_saldo) {
+		int32_t extent = (src->flags_1 & FLAGS1_X_Y_FLIP) ? (src->w << dw) : (src->h << dh);
+		mark_dirty_rows(dest, src->y, src->y + extent - 1);
+	}
+
 	for (int y = starty; y < endy; y++) {
 		for (int x = startx; x < endx; x++) {
 			if (pixel_saldo) {
@@ -275,6 +393,8 @@ uint32_t blitter_ic::clear_surface(const uint8_t dest)
 	uint32_t pixels = d->w * d->h;
 	uint32_t old_pixel_saldo = pixel_saldo;
 
+	mark_dirty_range(d->base_address, (pixels < pixel_saldo ? pixels : pixel_saldo) << 2);
+
 	for (uint32_t i=0; i < pixels; i++) {
 		if (pixel_saldo) {
 			blend(draw_color_addr, (d->base_address + (i << 2)) & VRAM_SIZE_MASK);
@@ -289,7 +409,9 @@ uint32_t blitter_ic::clear_surface(const uint8_t dest)
 uint32_t blitter_ic::pset(int16_t x0, int16_t y0, uint8_t d)
 {
 	if (pixel_saldo) {
-		blend(draw_color_addr, (surface[d & 0b1111].base_address + (((y0 * surface[d & 0b1111].w) + x0) << 2)) & VRAM_SIZE_MASK);
+		uint32_t address = (surface[d & 0b1111].base_address + (((y0 * surface[d & 0b1111].w) + x0) << 2)) & VRAM_SIZE_MASK;
+		blend(draw_color_addr, address);
+		mark_dirty(address);
 		pixel_saldo--;
 		return 1;
 	}
@@ -311,6 +433,8 @@ uint32_t blitter_ic::line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_
 
 	int16_t err = dx - dy;
 
+	if (pixel_saldo) mark_dirty_rows(s, y0 < y1 ? y0 : y1, y0 < y1 ? y1 : y0);
+
 	while (x0 != x1 || y0 != y1) {
 		if ((x0 >= 0) && (x0 < s->w) && (y0 >= 0) && (y0 < s->h)) {
 			if (pixel_saldo) {
@@ -341,6 +465,14 @@ uint32_t blitter_ic::line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_
 	return  old_pixel_saldo - pixel_saldo;
 }
 
+void blitter_ic::mark_dirty_rows(const surface_t *s, int32_t y0, int32_t y1)
+{
+	if (y0 < 0) y0 = 0;
+	if (y1 > s->h - 1) y1 = s->h - 1;
+	if (y0 > y1) return;
+	mark_dirty_range(s->base_address + ((y0 * s->w) << 2), ((y1 - y0 + 1) * s->w) << 2);
+}
+
 uint32_t blitter_ic::rectangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t d)
 {
 	uint32_t pixels{0};
@@ -436,6 +568,7 @@ void blitter_ic::io_write8(uint16_t address, uint8_t value)
 					vram[draw_color_addr + 1] = vram[palette_addr + (value << 2) + 1];
 					vram[draw_color_addr + 2] = vram[palette_addr + (value << 2) + 2];
 					vram[draw_color_addr + 3] = vram[palette_addr + (value << 2) + 3];
+					mark_dirty(draw_color_addr);
 					break;
 				case 0x08: x0 = (int16_t)((((uint16_t)x0) & 0x00ff) | (value << 8)); break;
 				case 0x09: x0 = (int16_t)((((uint16_t)x0) & 0xff00) | value);        break;
@@ -462,6 +595,7 @@ void blitter_ic::io_write8(uint16_t address, uint8_t value)
 			break;
 		case 0x100:
 			vram[(vram_peek + (address & 0xff)) & VRAM_SIZE_MASK] = value;
+			mark_dirty(vram_peek + (address & 0xff));
 			break;
 		case 0x200:
 			io_surfaces_write8(address & 0xff, value);
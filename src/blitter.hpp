@@ -13,6 +13,7 @@
 #include "common.hpp"
 #include "font_4x6.hpp"
 #include "font_cbm_8x8.hpp"
+#include "state.hpp"
 
 #define FLAGS0_NOFONT		0b00000000
 #define FLAGS0_TINYFONT		0b01000000
@@ -23,6 +24,17 @@
 #define FLAGS1_VER_FLIP		0b00100000
 #define	FLAGS1_X_Y_FLIP		0b01000000
 
+/*
+ * Size of the shared block holding the vram reset pattern, mapped
+ * repeatedly to cover all of vram (must be a multiple of the host
+ * page size)
+ */
+#define VRAM_PATTERN_SIZE	0x40000
+
+#ifndef VRAM_DIRTY_TRACKING
+#define VRAM_DIRTY_TRACKING	1
+#endif
+
 // for both pixels and tiles!!!
 // need to write documentation
 struct surface_t {
@@ -148,6 +160,20 @@ private:
 
 	const uint32_t draw_color_addr = 0xf3e800;
 
+	/*
+	 * Dirty page tracking. Every write into vram stamps its page with
+	 * the current epoch, see dirty_checkpoint(). Building with
+	 * VRAM_DIRTY_TRACKING 0 (only done by tests/vram_bench) leaves
+	 * marking out and has all pages dirty, all the time.
+	 */
+	uint32_t page_epoch[VRAM_PAGES];
+	uint32_t dirty_epoch{1};
+
+	/*
+	 * Marks the rows y0 to y1 of a surface (clipped)
+	 */
+	void mark_dirty_rows(const surface_t *s, int32_t y0, int32_t y1);
+
 public:
 	blitter_ic();
 	~blitter_ic();
@@ -201,10 +227,86 @@ public:
 	uint32_t rectangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t d);
 	uint32_t solid_rectangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t d);
 
+	/*
+	 * Whether the destination surface has bytes below address, taking
+	 * the wrap at the end of vram into account. Operations are clipped
+	 * to their destination surface, so nothing else can be written.
+	 */
+	bool dst_surface_below(uint32_t address) {
+		const surface_t *d = &surface[dst_surface];
+		uint64_t start = d->base_address & VRAM_SIZE_MASK;
+		uint64_t bytes = ((uint64_t)d->w * d->h) << 2;
+		return bytes && ((start < address) || (start + bytes > VRAM_SIZE));
+	}
+	uint32_t get_vram_peek() { return vram_peek; }
+
 	void set_pixel_saldo(uint32_t s) { pixel_saldo = s; }
 	uint32_t get_pixel_saldo() { return pixel_saldo; }
 
+	/*
+	 * Registers and surfaces, vram is taken care of by snapshot_t
+	 */
+	void save_state(state_t *s);
+	void load_state(state_t *s);
+
 	uint8_t *vram;
+
+	/*
+	 * Vram is an address space reservation. Pages that weren't written
+	 * since the last reset are copy on write mappings of one small
+	 * shared block holding the reset pattern, they read as that
+	 * pattern without taking memory of their own. reset_vram() drops
+	 * all written pages again.
+	 */
+	static uint8_t *allocate_vram();
+	static void free_vram(uint8_t *v);
+	static void reset_vram(uint8_t *v);
+
+	/*
+	 * To be called by everything that writes into vram behind the
+	 * back of the blitter. Ranges are marked once (e.g. per row of
+	 * pixels), not per byte.
+	 */
+	inline void mark_dirty(uint32_t address) {
+#if VRAM_DIRTY_TRACKING
+		page_epoch[(address & VRAM_SIZE_MASK) >> VRAM_PAGE_SHIFT] = dirty_epoch;
+#endif
+	}
+
+	inline void mark_dirty_range(uint32_t address, uint32_t bytes) {
+#if VRAM_DIRTY_TRACKING
+		if (!bytes) return;
+		if (bytes > VRAM_SIZE - VRAM_PAGE_SIZE) {
+			mark_all_dirty();
+			return;
+		}
+		uint32_t page = (address & VRAM_SIZE_MASK) >> VRAM_PAGE_SHIFT;
+		uint32_t last = ((address + bytes - 1) & VRAM_SIZE_MASK) >> VRAM_PAGE_SHIFT;
+		for (;;) {
+			page_epoch[page] = dirty_epoch;
+			if (page == last) break;
+			page = (page + 1) & (VRAM_PAGES - 1);
+		}
+#endif
+	}
+
+	inline void mark_all_dirty() {
+		for (int i=0; i<VRAM_PAGES; i++) page_epoch[i] = dirty_epoch;
+	}
+
+	/*
+	 * Any number of users can track changes independently. A user
+	 * keeps the checkpoint it got last time, pages written since are
+	 * dirty for that user. A checkpoint of 0 means all pages.
+	 */
+	inline uint32_t dirty_checkpoint() { return ++dirty_epoch; }
+	inline bool is_page_dirty(uint32_t page, uint32_t checkpoint) {
+#if VRAM_DIRTY_TRACKING
+		return page_epoch[page] >= checkpoint;
+#else
+		return true;
+#endif
+	}
 };
 
 #endif
@@ -52,6 +52,12 @@ public:
 	inline void adjust_target_clock(uint32_t target_clock_f) {
 		target_clock_freq = target_clock_f;
 	}
+
+	/*
+	 * Remainder carried to the next call, for snapshots
+	 */
+	inline uint64_t get_mod() { return mod; }
+	inline void set_mod(uint64_t m) { mod = m; }
 };
 
 #endif
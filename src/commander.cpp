@@ -10,7 +10,15 @@
 #include "debugger.hpp"
 #include "terminal.hpp"
 
-system_t *sys;
+/*
+ * The owning system is stored as the shared foreign pointer of the
+ * virtual machine (visible from all its threads), so several
+ * commanders can live side by side.
+ */
+static inline system_t *sys(HSQUIRRELVM v)
+{
+	return (system_t *)sq_getsharedforeignptr(v);
+}
 
 static SQInteger s_poke(HSQUIRRELVM v)
 {
@@ -18,7 +26,7 @@ static SQInteger s_poke(HSQUIRRELVM v)
 	SQInteger value;
 	sq_getinteger(v, -2, &address);
 	sq_getinteger(v, -1, &value);
-	sys->core->write8((uint16_t)address, (uint8_t)value);
+	sys(v)->core->write8((uint16_t)address, (uint8_t)value);
 	return 0;
 }
 
@@ -26,7 +34,7 @@ static SQInteger s_peek(HSQUIRRELVM v)
 {
 	SQInteger address;
 	sq_getinteger(v, -1, &address);
-	sq_pushinteger(v, sys->core->read8((uint16_t)address));
+	sq_pushinteger(v, sys(v)->core->read8((uint16_t)address));
 	return 1;
 }
 
@@ -36,8 +44,8 @@ static SQInteger s_poke16(HSQUIRRELVM v)
 	SQInteger value;
 	sq_getinteger(v, -2, &address);
 	sq_getinteger(v, -1, &value);
-	sys->core->write8((uint16_t)address, (uint16_t)value >> 8);
-	sys->core->write8((uint16_t)address + 1, (uint16_t)value & 0xff);
+	sys(v)->core->write8((uint16_t)address, (uint16_t)value >> 8);
+	sys(v)->core->write8((uint16_t)address + 1, (uint16_t)value & 0xff);
 	return 0;
 }
 
@@ -45,7 +53,7 @@ static SQInteger s_peek16(HSQUIRRELVM v)
 {
 	SQInteger address;
 	sq_getinteger(v, -1, &address);
-	sq_pushinteger(v, (sys->core->read8((uint16_t)address) << 8) | sys->core->read8((uint16_t)address + 1));
+	sq_pushinteger(v, (sys(v)->core->read8((uint16_t)address) << 8) | sys(v)->core->read8((uint16_t)address + 1));
 	return 1;
 }
 
@@ -55,7 +63,9 @@ static SQInteger s_vpoke(HSQUIRRELVM v)
 	SQInteger value;
 	sq_getinteger(v, -2, &address);
 	sq_getinteger(v, -1, &value);
-	sys->core->blitter->vram[address & VRAM_SIZE_MASK] = (uint8_t)value;
+	sys(v)->core->blitter->vram[address & VRAM_SIZE_MASK] = (uint8_t)value;
+	sys(v)->core->blitter->mark_dirty(address);
+	if ((address & VRAM_SIZE_MASK) < 0x10000) sys(v)->core->cpu->invalidate_decode_cache(address);
 	return 0;
 }
 
@@ -63,13 +73,13 @@ static SQInteger s_vpeek(HSQUIRRELVM v)
 {
 	SQInteger address;
 	sq_getinteger(v, -1, &address);
-	sq_pushinteger(v, sys->core->blitter->vram[address & VRAM_SIZE_MASK]);
+	sq_pushinteger(v, sys(v)->core->blitter->vram[address & VRAM_SIZE_MASK]);
 	return 1;
 }
 
 commander_t::commander_t(system_t *s)
 {
-	system = sys = s;
+	system = s;
 }
 
 commander_t::~commander_t()
@@ -162,7 +172,7 @@ midi <- [
 
 )Squirrel";
 
-void printfunc(HSQUIRRELVM SQ_UNUSED_ARG(v), const SQChar *s, ...)
+void printfunc(HSQUIRRELVM v, const SQChar *s, ...)
 {
 	char buffer[1024];
 	va_list arglist;
@@ -170,10 +180,10 @@ void printfunc(HSQUIRRELVM SQ_UNUSED_ARG(v), const SQChar *s, ...)
 	//vprintf(s, arglist);
 	vsnprintf(buffer, 1024, s, arglist);
 	va_end(arglist);
-	sys->debugger->terminal->puts(buffer);
+	sys(v)->debugger->terminal->puts(buffer);
 }
 
-void errorfunc(HSQUIRRELVM SQ_UNUSED_ARG(v),const SQChar *s,...)
+void errorfunc(HSQUIRRELVM v,const SQChar *s,...)
 {
 	char buffer[1024];
 	va_list vl;
@@ -181,7 +191,7 @@ void errorfunc(HSQUIRRELVM SQ_UNUSED_ARG(v),const SQChar *s,...)
 	//vprintf(s, vl);
 	vsnprintf(buffer, 1024, s, vl);
 	va_end(vl);
-	sys->debugger->terminal->puts(buffer);
+	sys(v)->debugger->terminal->puts(buffer);
 }
 
 void commander_t::reset()
@@ -196,6 +206,7 @@ void commander_t::reset()
 	}
 
 	v = sq_open(1024);
+	sq_setsharedforeignptr(v, system);
 	sqstd_seterrorhandlers(v);
 	sq_setprintfunc(v, printfunc, errorfunc);
 
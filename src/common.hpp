@@ -21,6 +21,9 @@
 // ---------------------------------------------------------------------
 #define VRAM_SIZE				0x1000000
 #define VRAM_SIZE_MASK			(VRAM_SIZE-1)
+#define VRAM_PAGE_SHIFT			12		// 4kb pages for dirty tracking and snapshots
+#define VRAM_PAGE_SIZE			(1 << VRAM_PAGE_SHIFT)
+#define VRAM_PAGES				(VRAM_SIZE >> VRAM_PAGE_SHIFT)
 #define FPS						60
 #define MAX_PIXELS_PER_SCANLINE	288
 #define MAX_SCANLINES			162
@@ -32,7 +35,11 @@
 // audio
 // ---------------------------------------------------------------------
 #define SAMPLE_RATE				48000
-#define AUDIO_BUFFER_SIZE		8000.0
+#define AUDIO_LATENCY_MS		16		// target fill of audio ring buffer
+#define AUDIO_RING_SIZE			8192	// stereo frames, power of two
+#define AUDIO_MAX_DRIFT			0.005	// max resampling deviation (0.5%)
+#define AUDIO_DEVICE_SAMPLES	256		// samples per audio callback
+#define AUDIO_TURBO_CROSSFADE	64		// stereo frames between turbo grains
 #define SID_CLOCK_SPEED			985248
 #define SID_CYCLES_PER_FRAME	(SID_CLOCK_SPEED/FPS)
 
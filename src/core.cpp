@@ -8,8 +8,9 @@
 #include "common.hpp"
 #include "core.hpp"
 #include "keyboard.hpp"
+#include <cstring>
 
-extern uint8_t rom[];
+extern const uint8_t rom[];
 
 core_t::core_t(system_t *s)
 {
@@ -19,6 +20,19 @@ core_t::core_t(system_t *s)
 
 	cpu = new cpu_t(system);
 
+	/*
+	 * Only pages backed by plain vram or rom can be cached by the
+	 * decode cache of the cpu, io pages are excluded.
+	 */
+	for (int page=0; page<256; page++) {
+		cpu->set_decode_cache_page(page,
+			(page != COMBINED_PAGE) &&
+			(page != KEYBOARD_PAGE) &&
+			((page & 0xfe) != SOUND_PAGE) &&
+			((page & 0xfc) != BLITTER_PAGE) &&
+			((page & 0xf0) != BLITTER_COLOR_TABLES));
+	}
+
 	exceptions = new exceptions_ic();
 	cpu->assign_nmi_line(&exceptions->nmi_output_pin);
 	cpu->assign_irq_line(&exceptions->irq_output_pin);
@@ -68,6 +82,7 @@ uint8_t core_t::read8(uint16_t address)
 			return system->keyboard->io_read8(address);
 		case SOUND_PAGE:
 		case SOUND_PAGE+1:
+			sound_catch_up(cpu->clock_ticks_instruction_start());
 			return sound->io_read_byte(address & 0x1ff);
 		case BLITTER_PAGE:
 		case BLITTER_PAGE+1:	// vram peek
@@ -111,7 +126,14 @@ void core_t::write8(uint16_t address, uint8_t value) {
 					io_write8(address, value);
 					break;
 				case TIMER_SUB_PAGE:
+					timer_catch_up(cpu->clock_ticks_instruction_start());
 					timer->io_write_byte(address & 0x1f, value);
+					/*
+					 * A timer interrupt may be due earlier now. Ending a
+					 * fused sequence of the cpu here makes sure it's
+					 * taken after this instruction, as without fusion.
+					 */
+					cpu->set_next_event(cpu->clock_ticks());
 					break;
 				case COMMANDER_SUB_PAGE:
 					commander->io_write8(address & 0x1f, value);
@@ -126,6 +148,7 @@ void core_t::write8(uint16_t address, uint8_t value) {
 			break;
 		case SOUND_PAGE:
 		case SOUND_PAGE+1:
+			sound_catch_up(cpu->clock_ticks_instruction_start());
 			sound->io_write_byte(address & 0x1ff, value);
 			break;
 		case BLITTER_PAGE:
@@ -133,6 +156,16 @@ void core_t::write8(uint16_t address, uint8_t value) {
 		case BLITTER_PAGE+2:	// surfaces
 		case BLITTER_PAGE+3:	// color tables
 			blitter->io_write8(address, value);
+			/*
+			 * Blitter operations and vram peek writes may end up in
+			 * the address space of the cpu.
+			 */
+			if ((address & 0x3ff) == 0x001) {
+				if (blitter->dst_surface_below(0x10000)) cpu->flush_decode_cache();
+			} else if ((address & 0x300) == 0x100) {
+				uint32_t vram_address = (blitter->get_vram_peek() + (address & 0xff)) & VRAM_SIZE_MASK;
+				if (vram_address < 0x10000) cpu->invalidate_decode_cache(vram_address);
+			}
 			break;
 		case BLITTER_COLOR_TABLES:
 		case BLITTER_COLOR_TABLES+1:
@@ -154,6 +187,8 @@ void core_t::write8(uint16_t address, uint8_t value) {
 			break;
 		default:
 			blitter->vram[address] = value;
+			blitter->mark_dirty(address);
+			cpu->invalidate_decode_cache(address);
 			break;
 	}
 }
@@ -163,9 +198,11 @@ void core_t::reset()
 	cpu_cycle_saldo = 0;
 	irq_line_frame_done = true;
 
+	sound_catch_up(cpu->clock_ticks());
 	sound->reset();
 	timer->reset();
 	cpu->reset();
+	timer_cpu_ticks = cpu->clock_ticks();
 	blitter->reset();
 
 	blitter->set_pixel_saldo(MAX_PIXELS_PER_FRAME);
@@ -183,6 +220,12 @@ void core_t::reset()
 	// TODO: remove this later
 	// some little check if deadbeef looks SCRAMBLED meaning host is little endian
 	*(uint32_t *)&blitter->vram[0x2000] = 0xefbeadde;
+	blitter->mark_dirty(0x2000);
+
+	/*
+	 * Vram was rewritten behind the back of the cpu
+	 */
+	cpu->flush_decode_cache();
 
 	commander->reset();
 }
@@ -192,16 +235,27 @@ enum output_states core_t::run(bool debug)
 	enum output_states output_state = NORMAL;
 
 	do {
+		/*
+		 * Next event is either a timer interrupt or end of frame. In
+		 * debug mode, no more than one instruction at a time.
+		 */
+		uint32_t next_event = debug ? 0 : CPU_CYCLES_PER_FRAME - cpu_cycle_saldo;
+		uint32_t next_timer_event = timer->cycles_to_next_event();
+		if (next_timer_event < next_event) next_event = next_timer_event;
+		cpu->set_next_event(cpu->clock_ticks() + next_event);
 
 		uint16_t cpu_cycles = cpu->execute();
-		timer->run(cpu_cycles);
-		uint16_t sound_cycles = cpu2sid->clock(cpu_cycles);
-		sound->run(sound_cycles);
+		timer_catch_up(cpu->clock_ticks());
 		cpu_cycle_saldo += cpu_cycles;
-		sound_cycle_saldo += sound_cycles;
 
 	} while ((!cpu->breakpoint()) && (cpu_cycle_saldo < CPU_CYCLES_PER_FRAME) && (!debug));
 
+	/*
+	 * Sids and analogs are only brought up to date here, or earlier
+	 * when the cpu touches the sound registers (see read8/write8).
+	 */
+	sound_catch_up(cpu->clock_ticks());
+
 	if (cpu->breakpoint()) output_state = BREAKPOINT;
 
 	if (cpu_cycle_saldo >= CPU_CYCLES_PER_FRAME) {
@@ -280,3 +334,57 @@ void core_t::load_squirrel(const char *p)
 		}
 	}
 }
+
+void core_t::save_state(state_t *s)
+{
+	struct mc6809_state_t cpu_state;
+	memset(&cpu_state, 0, sizeof(cpu_state));	// no stray padding bytes
+	cpu->get_state(&cpu_state);
+	s->put(cpu_state);
+
+	s->put(cpu_cycle_saldo);
+	s->put(sound_cycle_saldo);
+	s->put(sound_cpu_ticks);
+	s->put(irq_line_frame_done);
+	s->put(irq_line_load_bin);
+	s->put(irq_line_load_squirrel);
+	s->put(generate_interrupts_frame_done);
+	s->put(generate_interrupts_load_bin);
+	s->put(generate_interrupts_load_squirrel);
+	s->put(cpu2sid->get_mod());
+
+	exceptions->save_state(s);
+	timer->save_state(s);
+	blitter->save_state(s);
+	sound->save_state(s);
+}
+
+void core_t::load_state(state_t *s)
+{
+	struct mc6809_state_t cpu_state;
+	s->get(cpu_state);
+	cpu->set_state(&cpu_state);
+
+	s->get(cpu_cycle_saldo);
+	s->get(sound_cycle_saldo);
+	s->get(sound_cpu_ticks);
+	s->get(irq_line_frame_done);
+	s->get(irq_line_load_bin);
+	s->get(irq_line_load_squirrel);
+	s->get(generate_interrupts_frame_done);
+	s->get(generate_interrupts_load_bin);
+	s->get(generate_interrupts_load_squirrel);
+	uint64_t mod;
+	s->get(mod);
+	cpu2sid->set_mod(mod);
+
+	/*
+	 * States are taken in between runs, the timer is up to date then
+	 */
+	timer_cpu_ticks = cpu->clock_ticks();
+
+	exceptions->load_state(s);
+	timer->load_state(s);
+	blitter->load_state(s);
+	sound->load_state(s);
+}
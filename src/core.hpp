@@ -17,6 +17,7 @@
 #include "timer.hpp"
 #include "clocks.hpp"
 #include "commander.hpp"
+#include "state.hpp"
 
 #define COMBINED_PAGE			0x04
 #define CORE_SUB_PAGE				0x00
@@ -39,6 +40,22 @@ private:
 	int32_t cpu_cycle_saldo{0};
 	uint32_t sound_cycle_saldo;
 
+	/*
+	 * Sound is emulated lazily. This is the cpu clock tick up to
+	 * which sound has been run. Cpu cycles are only converted and
+	 * handed to the sound ic when it's accessed by the cpu, or at
+	 * the end of a run.
+	 */
+	uint32_t sound_cpu_ticks{0};
+
+	/*
+	 * Cpu clock tick up to which the timer has run. Normally the timer
+	 * runs after every call of cpu->execute(), but within a fused
+	 * sequence of instructions it's brought up to date before a write
+	 * to it, as it would have been without fusion.
+	 */
+	uint32_t timer_cpu_ticks{0};
+
 	uint8_t irq_number;
 
 	bool irq_line_frame_done{true};
@@ -65,6 +82,22 @@ public:
 
 	enum output_states run(bool debug);
 
+	inline void timer_catch_up(uint32_t cpu_ticks) {
+		if ((int32_t)(cpu_ticks - timer_cpu_ticks) > 0) {
+			timer->run(cpu_ticks - timer_cpu_ticks);
+			timer_cpu_ticks = cpu_ticks;
+		}
+	}
+
+	inline void sound_catch_up(uint32_t cpu_ticks) {
+		if ((int32_t)(cpu_ticks - sound_cpu_ticks) > 0) {
+			uint32_t sound_cycles = cpu2sid->clock(cpu_ticks - sound_cpu_ticks);
+			sound->run(sound_cycles);
+			sound_cycle_saldo += sound_cycles;
+			sound_cpu_ticks = cpu_ticks;
+		}
+	}
+
 	uint8_t read8(uint16_t address);
 	void write8(uint16_t address, uint8_t value);
 
@@ -81,6 +114,13 @@ public:
 
 	void load_bin();
 	void load_squirrel(const char *p);
+
+	/*
+	 * Serialises everything but vram and the commander, see
+	 * snapshot_t
+	 */
+	void save_state(state_t *s);
+	void load_state(state_t *s);
 };
 
 #endif
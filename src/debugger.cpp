@@ -6,8 +6,10 @@
  */
 
 #include "debugger.hpp"
+#include "rewind.hpp"
 #include "common.hpp"
 #include <cstdio>
+#include <cstring>
 
 /*
  * hex2int
@@ -58,8 +60,8 @@ debugger_t::debugger_t(system_t *s)
 	blitter->surface[0xe].flags_2 = 0b00000'001;	// select tiny font 4x6
 
 	/* character screen in slot 0xd */
-	blitter->surface[0xd].w = 72;
-	blitter->surface[0xd].h = 25;
+	blitter->surface[0xd].w = DEBUGGER_TERMINAL_COLUMNS;
+	blitter->surface[0xd].h = DEBUGGER_TERMINAL_ROWS;
 	blitter->surface[0xd].base_address = 0x00010000;
 	blitter->surface[0xd].x = 0;
 	blitter->surface[0xd].y = 6;
@@ -139,8 +141,28 @@ debugger_t::~debugger_t()
 	delete blitter;
 }
 
-void debugger_t::redraw()
+bool debugger_t::redraw()
 {
+	/*
+	 * Only redraw when something visible changed: terminal contents
+	 * (characters and colors, including the cursor), palette or
+	 * Bruce (animated, so always).
+	 */
+	const uint8_t *terminal_data = &blitter->vram[blitter->surface[0xd].base_address];
+	const uint8_t *palette_data = &system->core->blitter->vram[0xc00];
+
+	if (redraw_snapshot_valid && !bruce_visible &&
+	    (palette_visible == redraw_snapshot_palette_visible) &&
+	    (memcmp(terminal_data, redraw_snapshot_terminal, sizeof(redraw_snapshot_terminal)) == 0) &&
+	    (!palette_visible || (memcmp(palette_data, redraw_snapshot_palette, sizeof(redraw_snapshot_palette)) == 0))) {
+		return false;
+	}
+
+	memcpy(redraw_snapshot_terminal, terminal_data, sizeof(redraw_snapshot_terminal));
+	memcpy(redraw_snapshot_palette, palette_data, sizeof(redraw_snapshot_palette));
+	redraw_snapshot_palette_visible = palette_visible;
+	redraw_snapshot_valid = true;
+
 	blitter->set_pixel_saldo(MAX_PIXELS_PER_FRAME);
 
 	blitter->io_write8(0x05, cc);	// set clear color
@@ -166,45 +188,42 @@ void debugger_t::redraw()
 	blitter->solid_rectangle(0, 156, 287, 161, 0x0);
 
 	// Bruce Lee
-	static int state = 0;
-	static int wait = 100;
-	static bool right = true;
-	static bool change_direction = true;
-
 	if (bruce_visible) {
-		right ? blitter->surface[0xc].flags_1 &= 0b11101111 : blitter->surface[0xc].flags_1 |= 0b00010000;
+		bruce_right ? blitter->surface[0xc].flags_1 &= 0b11101111 : blitter->surface[0xc].flags_1 |= 0b00010000;
 
-		if (wait < 200) {
+		if (bruce_wait < 200) {
 			blitter->surface[0xc].index = 0;
-			state = 0;
+			bruce_state = 0;
 		} else {
-			if (change_direction) {
-				if (bruce_rand.byte() < 128) right = true; else right = false;
-				change_direction = false;
+			if (bruce_change_direction) {
+				if (bruce_rand.byte() < 128) bruce_right = true; else bruce_right = false;
+				bruce_change_direction = false;
 			}
 
-			if (state > 4) {
+			if (bruce_state > 4) {
 				blitter->surface[0xc].index = 1;
 			} else {
 				blitter->surface[0xc].index = 2;
 			}
 
-			blitter->surface[0xc].x += 2 * (right ? 1 : -1);
+			blitter->surface[0xc].x += 2 * (bruce_right ? 1 : -1);
 			if (blitter->surface[0xc].x > 308) {
 				blitter->surface[0xc].x = -20;
 			} else if (blitter->surface[0xc].x < -20) {
 				blitter->surface[0xc].x = 308;
 			}
 
-			state++; if (state == 8) state = 0;
+			bruce_state++; if (bruce_state == 8) bruce_state = 0;
 		}
-		wait++; if (wait > 300) {
-			wait = 0;
-			change_direction = true;
+		bruce_wait++; if (bruce_wait > 300) {
+			bruce_wait = 0;
+			bruce_change_direction = true;
 		}
 		blitter->blit(0xc, 0x0);
 	}
 	// end Bruce Lee
+
+	return true;
 }
 
 void debugger_t::run()
@@ -359,6 +378,21 @@ void debugger_t::process_command(char *c)
 	} else if (strcmp(token0, "irq") == 0) {
 		system->core->exceptions->toggle(irq_no);
 		status();
+	} else if (strcmp(token0, "load") == 0) {
+		token1 = strtok(NULL, " ");
+		if (token1 == NULL) {
+			if (!saved_state_valid) {
+				terminal->printf("\nerror: no state saved");
+			} else if (system->snapshot->restore(&saved_state)) {
+				terminal->printf("\nstate loaded (%.2f ms)", system->snapshot->get_duration_ms());
+			} else {
+				terminal->printf("\nerror: state can't be restored");
+			}
+		} else if (system->load_state(token1)) {
+			terminal->printf("\nstate loaded from '%s'", token1);
+		} else {
+			terminal->printf("\nerror: can't load state from '%s'", token1);
+		}
 	} else if (strcmp(token0, "m") == 0) {
 		have_prompt = false;
 		token1 = strtok(NULL, " ");
@@ -483,6 +517,18 @@ void debugger_t::process_command(char *c)
 		status();
 	} else if (strcmp(token0, "pal") == 0) {
 		palette_visible = !palette_visible;
+	} else if (strcmp(token0, "prof") == 0) {
+		/*
+		 * Toggles pair profiling of the cpu, report on stop
+		 */
+		if (system->core->cpu->pair_profile_enabled()) {
+			system->core->cpu->pair_profile_report(text_buffer, TEXT_BUFFER_SIZE, 5);
+			terminal->printf("\n%s", text_buffer);
+			system->core->cpu->set_pair_profile(false);
+		} else {
+			system->core->cpu->set_pair_profile(true);
+			terminal->printf("\npair profiling started, 'prof' again to stop");
+		}
 	} else if (strcmp(token0, "reset") == 0) {
 		terminal->printf("\nreset punch (y/n)");
 		redraw();
@@ -495,10 +541,39 @@ void debugger_t::process_command(char *c)
 		} else {
 			system->host->events_wait_until_key_released(SDLK_n);
 		}
+	} else if (strcmp(token0, "rw") == 0) {
+		/*
+		 * Steps back a number of frames (decimal, default 1)
+		 */
+		token1 = strtok(NULL, " ");
+		uint32_t frames = token1 ? strtoul(token1, NULL, 10) : 1;
+		if (!system->rewind_buffer->enabled()) {
+			terminal->printf("\nerror: rewind is disabled (see --rewind)");
+		} else if (system->rewind_buffer->frames_available() == 0) {
+			terminal->printf("\nerror: no frames to rewind");
+		} else {
+			uint32_t done = system->rewind_buffer->step_back(frames);
+			status();
+			terminal->printf("\nrewound %u frame(s), %u left (%.1f MB, capture %.2f ms)",
+				done, system->rewind_buffer->frames_available(),
+				(double)system->rewind_buffer->get_bytes() / (1 << 20),
+				system->rewind_buffer->get_capture_ms());
+		}
 	} else if (strcmp(token0, "run") == 0) {
 		have_prompt = false;
 		system->switch_to_run_mode();
 		system->host->events_wait_until_key_released(SDLK_RETURN);
+	} else if (strcmp(token0, "save") == 0) {
+		token1 = strtok(NULL, " ");
+		if (token1 == NULL) {
+			system->snapshot->take(&saved_state, STATE_FULL);
+			saved_state_valid = true;
+			terminal->printf("\nstate saved (%u bytes in %.2f ms)", (uint32_t)saved_state.get_size(), system->snapshot->get_duration_ms());
+		} else if (system->save_state(token1)) {
+			terminal->printf("\nstate saved to '%s'", token1);
+		} else {
+			terminal->printf("\nerror: can't save state to '%s'", token1);
+		}
 	} else if (strcmp(token0, "s") == 0) {
 		status();
 	} else if (strcmp(token0, "timer") == 0) {
@@ -843,8 +918,11 @@ void debugger_t::enter_vram_line(char *buffer)
 			}
 			if (correct) {
 				for (int i=0; i<columns; i++) {
-					system->core->blitter->vram[address + i] = values[i];
+					uint32_t vram_address = (address + i) & VRAM_SIZE_MASK;
+					system->core->blitter->vram[vram_address] = values[i];
+					if (vram_address < 0x10000) system->core->cpu->invalidate_decode_cache(vram_address);
 				}
+				system->core->blitter->mark_dirty_range(address, columns);
 				terminal->printf("\r");
 				vram_dump(address, columns);
 				terminal->printf("\n.;%06x.%02x ", (address + columns) & VRAM_SIZE_MASK, columns);
@@ -896,8 +974,11 @@ void debugger_t::enter_vram_binary_line(char *buffer)
 		}
 		if (correct) {
 			for (int i=0; i<columns; i++) {
-				system->core->blitter->vram[(address + i) & VRAM_SIZE_MASK] = (result >> ((columns - i - 1) * 8)) & 0xff;
+				uint32_t vram_address = (address + i) & VRAM_SIZE_MASK;
+				system->core->blitter->vram[vram_address] = (result >> ((columns - i - 1) * 8)) & 0xff;
+				if (vram_address < 0x10000) system->core->cpu->invalidate_decode_cache(vram_address);
 			}
+			system->core->blitter->mark_dirty_range(address, columns);
 			terminal->putchar('\r');
 			vram_binary_dump(address, columns);
 			terminal->printf("\n.\'%06x.%01x ", (address + columns) & VRAM_SIZE_MASK, columns);
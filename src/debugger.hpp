@@ -17,6 +17,9 @@
 
 #define T_BUFFER_SIZE 2048
 
+#define DEBUGGER_TERMINAL_COLUMNS	72
+#define DEBUGGER_TERMINAL_ROWS		25
+
 class debugger_t {
 public:
 	debugger_t(system_t *s);
@@ -24,7 +27,11 @@ public:
 
 	system_t *system;
 
-	void redraw();
+	/*
+	 * Returns false when nothing changed since the previous redraw,
+	 * the framebuffer then still contains that frame
+	 */
+	bool redraw();
 
 	void run();
 
@@ -86,10 +93,29 @@ private:
 	bool have_prompt{true};
 
 	bool bruce_visible{false};
+	int bruce_state{0};
+	int bruce_wait{100};
+	bool bruce_right{true};
+	bool bruce_change_direction{true};
 
 	bool palette_visible{false};
 
-	const uint8_t bruce_data[2*21*3] = {
+	/*
+	 * Snapshot slot for 'save' and 'load' without a file name
+	 */
+	state_t saved_state;
+	bool saved_state_valid{false};
+
+	/*
+	 * State the last redraw was based on (terminal tiles consist of
+	 * characters, foreground and background colors)
+	 */
+	bool redraw_snapshot_valid{false};
+	bool redraw_snapshot_palette_visible{false};
+	uint8_t redraw_snapshot_terminal[3 * DEBUGGER_TERMINAL_COLUMNS * DEBUGGER_TERMINAL_ROWS];
+	uint8_t redraw_snapshot_palette[1024];
+
+	static constexpr uint8_t bruce_data[2*21*3] = {
 		0b00000101, 0b00000000,	// ____bbbb________
 		0b00010110, 0b00000000,	// __bbbb..________
 		0b00011010, 0b01000000,	// __bb....bb______
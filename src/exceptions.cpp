@@ -62,3 +62,16 @@ void exceptions_ic::status(char *b, int buffer_length, uint8_t device)
 		b[0] = '\0';
 	}
 }
+
+void exceptions_ic::save_state(state_t *s)
+{
+	s->put_bytes(irq_input_pins, sizeof(irq_input_pins));
+	s->put(nmi_output_pin);
+}
+
+void exceptions_ic::load_state(state_t *s)
+{
+	s->get_bytes(irq_input_pins, sizeof(irq_input_pins));
+	s->get(nmi_output_pin);
+	update_status();
+}
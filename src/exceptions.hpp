@@ -14,6 +14,7 @@
 
 #include <cstdint>
 #include <string>
+#include "state.hpp"
 
 class exceptions_ic {
 private:
@@ -45,6 +46,9 @@ public:
 	void toggle(uint8_t device);
 	void status(char *b, int buffer_length);
 	void status(char *b, int buffer_length, uint8_t device);
+
+	void save_state(state_t *s);
+	void load_state(state_t *s);
 };
 
 #endif
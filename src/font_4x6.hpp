@@ -17,17 +17,36 @@
 
 class font_4x6_t {
 public:
-	uint8_t data[0x400]; // slightly larger then 768 bytes to make masking possible
-	uint32_t mask{0x3ff};
+	const uint8_t *data;
+	static constexpr uint32_t mask{0x3ff};
 
 	font_4x6_t() {
-		for (int i=0; i<0x300; i++) {
-			data[i] = (tiny_font_raw[i << 1] << 4) | tiny_font_raw[(i << 1) + 1];
-		}
+		data = packed_data();
 	}
 
 private:
-	const uint8_t tiny_font_raw[6 * 256] = {
+	/*
+	 * Packed font data is built once (thread safe static init) and
+	 * shared read-only by all blitter instances.
+	 */
+	struct packed_t {
+		uint8_t data[0x400]; // slightly larger then 768 bytes to make masking possible
+		packed_t() {
+			for (int i=0; i<0x300; i++) {
+				data[i] = (tiny_font_raw[i << 1] << 4) | tiny_font_raw[(i << 1) + 1];
+			}
+			for (int i=0x300; i<0x400; i++) {
+				data[i] = 0;
+			}
+		}
+	};
+
+	static const uint8_t *packed_data() {
+		static const packed_t packed;
+		return packed.data;
+	}
+
+	static constexpr uint8_t tiny_font_raw[6 * 256] = {
 		0b0000,	// $00
 		0b0000,
 		0b0000,
@@ -22,7 +22,10 @@
 
 class font_cbm_8x8_t {
 public:
-	uint8_t data[2048] = {
+	/*
+	 * Read-only and static, shared by all blitter instances
+	 */
+	static constexpr uint8_t data[2048] = {
 		0b00000000,		// $00 (space)
 		0b00000000,
 		0b00000000,
@@ -592,7 +595,7 @@ public:
 	    0xff, 0xff, 0x8f, 0x24, 0xf1, 0xff, 0xff, 0xff,
 	    0xff, 0xf7, 0xe3, 0xc9, 0x9c, 0x9c, 0x80, 0xff
 	};
-	uint32_t mask{0x7ff};
+	static constexpr uint32_t mask{0x7ff};
 
 };
 
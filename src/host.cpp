@@ -10,33 +10,26 @@
 #include "debugger.hpp"
 #include <thread>
 #include <chrono>
+#include <cstring>
+#include <ctime>
 #include <unistd.h>
 #include <iostream>
 #include <filesystem>
 
-host_t::host_t(system_t *s)
+host_t::host_t(system_t *s, bool h)
 {
-	core_buffer = new uint32_t[((2 * MAX_SCANLINES) + 1) * MAX_PIXELS_PER_SCANLINE];
-	for (int i=0; i<2*PIXELS; i++) {
-		core_buffer[i] = 0;
-	}
-
-	debugger_buffer = new uint32_t[((2 * MAX_SCANLINES) + 1) * MAX_PIXELS_PER_SCANLINE];
-	for (int i=0; i<2*PIXELS; i++) {
-		debugger_buffer[i] = 0;
-	}
+	headless = h;
 
 	system = s;
 
-	SDL_Init(SDL_INIT_EVERYTHING);
-
-	/*
-	 * Each call to SDL_PollEvent invokes SDL_PumpEvents() that
-	 * updates this array.
-	 */
-	sdl_keyboard_state = SDL_GetKeyboardState(NULL);
-
 	for (int i=0; i<128; i++) keyboard_state[i] = 0;
+	for (int i=0; i<SDL_NUM_SCANCODES; i++) sdl_keyboard_state[i] = 0;
+
+	if (headless) {
+		printf("[host] running headless, no audio and video\n");
+	} else {
+		SDL_Init(SDL_INIT_EVERYTHING);
+	}
 
 	SDL_version compiled;
 	SDL_VERSION(&compiled);
@@ -49,12 +42,20 @@ host_t::host_t(system_t *s)
 	//std::filesystem::path p = SDL_GetBasePath();
 	//std::cout << p << std::endl;
 
-	char *base_path = SDL_GetBasePath();
-	printf("[SDL] Base path is: %s\n", base_path);
-	SDL_free(base_path);
+	if (headless) {
+		/*
+		 * No SDL calls that touch global state, several headless
+		 * machines may be constructed on different threads
+		 */
+		sdl_preference_path = nullptr;
+	} else {
+		char *base_path = SDL_GetBasePath();
+		printf("[SDL] Base path is: %s\n", base_path);
+		SDL_free(base_path);
 
-	sdl_preference_path = SDL_GetPrefPath("elmerucr", "punch");
-	printf("[SDL] Preference path is: %s\n", sdl_preference_path);
+		sdl_preference_path = SDL_GetPrefPath("elmerucr", "punch");
+		printf("[SDL] Preference path is: %s\n", sdl_preference_path);
+	}
 
 #if defined(__APPLE__)
 	home = getenv("HOME");
@@ -66,18 +67,124 @@ host_t::host_t(system_t *s)
 #   error "Unknown compiler"
 #endif
 
-	audio_init();
-	video_init();
+	if (headless) {
+		/*
+		 * Same format as requested from SDL
+		 */
+		audio_bytes_per_sample = sizeof(float);
+		audio_bytes_per_ms = (double)SAMPLE_RATE * 2 * audio_bytes_per_sample / 1000;
+		vsync = false;
+	} else {
+		audio_init();
+		video_init();
+	}
 }
 
 host_t::~host_t()
 {
-	delete [] debugger_buffer;
-	delete [] core_buffer;
+	if (audio_dump) fclose(audio_dump);
+	if (video_dump) fclose(video_dump);
+	recorder.stop();
+
+	if (!headless) {
+		video_stop();
+		audio_stop();
+		SDL_free(sdl_preference_path);
+		SDL_Quit();
+	}
+}
+
+bool host_t::set_audio_dump(const char *path)
+{
+	if (audio_dump) fclose(audio_dump);
+	audio_dump = fopen(path, "wb");
+	if (!audio_dump) {
+		printf("[host] error: can't open '%s' for audio dump\n", path);
+		return false;
+	}
+	printf("[host] dumping audio to '%s' (stereo, 32 bit float, %i Hz)\n", path, SAMPLE_RATE);
+	return true;
+}
+
+bool host_t::start_audio_recording(const char *path)
+{
+	char name[1024];
+
+	if (path == nullptr) {
+		time_t now = time(nullptr);
+		char stamp[32];
+		strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+		snprintf(name, sizeof(name), "%spunch_%s.wav", sdl_preference_path ? sdl_preference_path : "", stamp);
+		path = name;
+	}
+
+	return recorder.start(path, headless);
+}
+
+void host_t::stop_audio_recording()
+{
+	recorder.stop();
+}
+
+void host_t::toggle_audio_recording()
+{
+	if (recorder.is_recording()) {
+		stop_audio_recording();
+	} else {
+		start_audio_recording();
+	}
+}
+
+void host_t::set_audio_turbo_frame(bool turbo, bool keep, bool stretch)
+{
+	if (!turbo) {
+		audio_crossfade_captured = 0;
+	} else if (keep && !audio_turbo_keep) {
+		audio_crossfade_position = 0;		// new grain
+	} else if (!keep && audio_turbo_keep) {
+		audio_crossfade_captured = 0;		// start capturing
+	}
+
+	audio_turbo = turbo;
+	audio_turbo_keep = keep;
+	audio_turbo_stretch = stretch;
+}
+
+bool host_t::audio_turbo_filter(float *buffer, uint32_t frames)
+{
+	if (!audio_turbo_keep) {
+		for (uint32_t i=0; (i < frames) && (audio_crossfade_captured < AUDIO_TURBO_CROSSFADE); i++) {
+			audio_crossfade[audio_crossfade_captured][0] = buffer[(2 * i) + 0];
+			audio_crossfade[audio_crossfade_captured][1] = buffer[(2 * i) + 1];
+			audio_crossfade_captured++;
+		}
+		return false;
+	}
+
+	if (!audio_turbo_stretch) {
+		for (uint32_t i=0; i < 2 * frames; i++) buffer[i] = 0.0;
+		return true;
+	}
+
+	for (uint32_t i=0; (i < frames) && (audio_crossfade_position < audio_crossfade_captured); i++) {
+		float w = (float)(audio_crossfade_position + 1) / (audio_crossfade_captured + 1);
+		buffer[(2 * i) + 0] = ((1.0 - w) * audio_crossfade[audio_crossfade_position][0]) + (w * buffer[(2 * i) + 0]);
+		buffer[(2 * i) + 1] = ((1.0 - w) * audio_crossfade[audio_crossfade_position][1]) + (w * buffer[(2 * i) + 1]);
+		audio_crossfade_position++;
+	}
+	return true;
+}
 
-	video_stop();
-	audio_stop();
-	SDL_Quit();
+bool host_t::set_video_dump(const char *path)
+{
+	if (video_dump) fclose(video_dump);
+	video_dump = fopen(path, "wb");
+	if (!video_dump) {
+		printf("[host] error: can't open '%s' for video dump\n", path);
+		return false;
+	}
+	printf("[host] dumping frames to '%s' (%ix%i, argb32)\n", path, MAX_PIXELS_PER_SCANLINE, MAX_SCANLINES);
+	return true;
 }
 
 void host_t::audio_init()
@@ -101,14 +208,17 @@ void host_t::audio_init()
 	audio_spec_want.freq = SAMPLE_RATE;
 	audio_spec_want.format = AUDIO_F32SYS;
 	audio_spec_want.channels = 2;
-	audio_spec_want.samples = 512;
-	audio_spec_want.callback = nullptr;
+	audio_spec_want.samples = AUDIO_DEVICE_SAMPLES;
+	audio_spec_want.callback = audio_callback;
+	audio_spec_want.userdata = this;
 
 	/*
-	 * Open audio device, allowing any changes to the specification
+	 * Open audio device. Format and channels must stay the same
+	 * (stereo floats in the ring buffer), a different frequency is
+	 * taken care of by the resampler.
 	 */
 	audio_device = SDL_OpenAudioDevice(NULL, 0, &audio_spec_want, &audio_spec_have,
-						 SDL_AUDIO_ALLOW_ANY_CHANGE);
+						 SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
 	if(!audio_device) {
 		printf("[SDL] failed to open audio device: %s\n", SDL_GetError());
 		// this is not enough and even wrong...
@@ -141,11 +251,87 @@ void host_t::audio_init()
 	audio_bytes_per_ms = (double)SAMPLE_RATE * audio_spec_have.channels * audio_bytes_per_sample / 1000;
 	printf("[SDL] audio is using %f bytes per ms\n", audio_bytes_per_ms);
 
+	audio_base_ratio = (double)SAMPLE_RATE / audio_spec_have.freq;
+	audio_target_frames = (SAMPLE_RATE * AUDIO_LATENCY_MS) / 1000;
+	audio_smoothed_fill = audio_target_frames;
+	printf("[SDL] audio ring buffer target is %u frames (%i ms)\n", audio_target_frames, AUDIO_LATENCY_MS);
+
 	audio_running = false;
 
 	audio_start();
 }
 
+void host_t::audio_callback(void *userdata, Uint8 *stream, int len)
+{
+	((host_t *)userdata)->audio_fill((audio_frame_t *)stream, len / sizeof(audio_frame_t));
+}
+
+void host_t::audio_fill(audio_frame_t *output, int frames)
+{
+	uint32_t available = audio_ring.size();
+
+	/*
+	 * At start and after an underrun, play silence until the ring
+	 * buffer is back at its target fill
+	 */
+	if (audio_priming) {
+		if (available < audio_target_frames) {
+			for (int i=0; i<frames; i++) {
+				output[i].left = output[i].right = 0.0;
+			}
+			return;
+		}
+		audio_priming = false;
+		audio_smoothed_fill = available;
+		audio_resample_position = 0.0;
+	}
+
+	/*
+	 * Fill level changes in steps of a frame's worth of audio, so it
+	 * is smoothed over many callbacks before steering the ratio.
+	 */
+	audio_smoothed_fill = (0.98 * audio_smoothed_fill) + (0.02 * available);
+
+	double error = (audio_smoothed_fill - audio_target_frames) / audio_target_frames;
+	if (error > 1.0) error = 1.0;
+	if (error < -1.0) error = -1.0;
+	double ratio = audio_base_ratio * (1.0 + (AUDIO_MAX_DRIFT * error));
+	audio_ratio = ratio;
+
+	int i = 0;
+	for (; i<frames; i++) {
+		uint32_t index = (uint32_t)audio_resample_position;
+		if ((index + 1) >= available) break;
+
+		/*
+		 * Linear interpolation between two input frames
+		 */
+		float fraction = audio_resample_position - index;
+		const audio_frame_t &a = audio_ring.peek(index);
+		const audio_frame_t &b = audio_ring.peek(index + 1);
+		output[i].left  = a.left  + (fraction * (b.left  - a.left));
+		output[i].right = a.right + (fraction * (b.right - a.right));
+
+		audio_resample_position += ratio;
+	}
+
+	if (i < frames) {
+		/*
+		 * Underrun, rest is silence
+		 */
+		audio_underruns++;
+		audio_priming = true;
+		for (; i<frames; i++) {
+			output[i].left = output[i].right = 0.0;
+		}
+	}
+
+	uint32_t consumed = (uint32_t)audio_resample_position;
+	if (consumed > available) consumed = available;
+	audio_ring.discard(consumed);
+	audio_resample_position -= consumed;
+}
+
 void host_t::audio_start()
 {
 	if (!audio_running) {
@@ -211,19 +397,66 @@ void host_t::video_init()
 				  SDL_WINDOW_SHOWN |
 				  SDL_WINDOW_ALLOW_HIGHDPI);
 
+	int window_width, window_height;
 	SDL_GetWindowSize(video_window, &window_width, &window_height);
 	printf("[SDL] Display window dimension: %u x %u pixels\n", window_width, window_height);
 
+	video_refresh_rate = dm.refresh_rate;
+
+	/*
+	 * Make sure mouse cursor isn't visible
+	 */
+	SDL_ShowCursor(SDL_DISABLE);
+
+	render_init();
+
+	video_copies = new triple_buffer_t<video_copy_t>;
+	for (int i=0; i<3; i++) {
+		video_copy_t &c = video_copies->back();
+		for (int j=0; j<PIXELS; j++) c.core[j] = c.debugger[j] = 0;
+		c.frame.core = c.core;
+		c.frame.debugger = c.debugger;
+		c.frame.debugger_generation = 0;
+		c.frame.mode = RUN_MODE;
+		c.frame.viewer_visible = false;
+		c.frame.scanlines = scanlines;
+		video_copies->publish();
+		video_copies->acquire();
+	}
+
+	// set here, the emulation thread may stop it before run_display()
+	display_running = true;
+}
+
+void host_t::video_stop()
+{
+	delete video_copies;
+	video_copies = nullptr;
+
+	SDL_DestroyTexture(scanlines_texture);
+	SDL_DestroyTexture(debugger_texture);
+	SDL_DestroyTexture(core_texture);
+	SDL_DestroyRenderer(video_renderer);
+	SDL_DestroyWindow(video_window);
+}
+
+void host_t::render_init()
+{
 	/*
 	 * Create renderer and link it to window
 	 */
-	printf("[SDL] Display refresh rate of current display is %iHz\n", dm.refresh_rate);
-	if (dm.refresh_rate == FPS) {
-		printf("[SDL] Display: this is equal to the FPS of punch, trying for vsync\n");
+	printf("[SDL] Display refresh rate of current display is %iHz\n", video_refresh_rate);
+	if (video_refresh_rate >= FPS) {
+		/*
+		 * Also at 120, 144 or 165Hz. A new frame is presented at the
+		 * first refresh after it's ready and stays on screen until the
+		 * next one, emulation paces itself evenly at 60Hz.
+		 */
+		printf("[SDL] Display: refresh rate of at least the FPS of punch, trying for vsync\n");
 		SDL_SetHint(SDL_HINT_RENDER_VSYNC, "1");
 		video_renderer = SDL_CreateRenderer(video_window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 	} else {
-		printf("[SDL] Display: this differs from the FPS of punch, going for software FPS\n");
+		printf("[SDL] Display: refresh rate below the FPS of punch, presenting without vsync\n");
 		video_renderer = SDL_CreateRenderer(video_window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE);
 	}
 
@@ -247,141 +480,155 @@ void host_t::video_init()
 	 */
 	create_core_texture();
 	create_debugger_texture();
+	create_scanlines_texture();
 
 	// started in windowed mode!
+	int window_width, window_height;
+	SDL_GetWindowSize(video_window, &window_width, &window_height);
 	SDL_RenderSetLogicalSize(video_renderer, window_width, window_height);
-
-	/*
-	 * Make sure mouse cursor isn't visible
-	 */
-	SDL_ShowCursor(SDL_DISABLE);
-}
-
-void host_t::video_stop()
-{
-	SDL_DestroyTexture(debugger_texture);
-	SDL_DestroyTexture(core_texture);
-	SDL_DestroyRenderer(video_renderer);
-	SDL_DestroyWindow(video_window);
+	uploaded_debugger_generation = 0;
 }
 
-void host_t::update_core_texture(uint32_t *core)
+void host_t::run_display()
 {
-	uint8_t *core_8 = (uint8_t *)core;
-	uint8_t *core_8_next = core_8 + (MAX_PIXELS_PER_SCANLINE << 2);
-	uint8_t *core_buffer_8 = (uint8_t *)core_buffer;
-
-	if (scanlines) {
-		for (int y=0; y<(MAX_SCANLINES - 1); y++) {
-			for (int x=0; x<MAX_PIXELS_PER_SCANLINE; x++) {
-
-				core_buffer_8[MAX_PIXELS_PER_SCANLINE * (y << 3) + (x << 2) + 0] = *core_8;
-				core_buffer_8[MAX_PIXELS_PER_SCANLINE * (y << 3) + (x << 2) + 1] = *(core_8 + 1);
-				core_buffer_8[MAX_PIXELS_PER_SCANLINE * (y << 3) + (x << 2) + 2] = *(core_8 + 2);
-				core_buffer_8[MAX_PIXELS_PER_SCANLINE * (y << 3) + (x << 2) + 3] = *(core_8 + 3);
-				// odd line
-				core_buffer_8[MAX_PIXELS_PER_SCANLINE * ((y << 3) + (1 << 2)) + (x << 2) + 0] = scanlines_value;
-				core_buffer_8[MAX_PIXELS_PER_SCANLINE * ((y << 3) + (1 << 2)) + (x << 2) + 1] = ((*(core_8 + 1)) >> 1) + ((*(core_8_next + 1)) >> 1);
-				core_buffer_8[MAX_PIXELS_PER_SCANLINE * ((y << 3) + (1 << 2)) + (x << 2) + 2] = ((*(core_8 + 2)) >> 1) + ((*(core_8_next + 2)) >> 1);
-				core_buffer_8[MAX_PIXELS_PER_SCANLINE * ((y << 3) + (1 << 2)) + (x << 2) + 3] = ((*(core_8 + 3)) >> 1) + ((*(core_8_next + 3)) >> 1);
-
-				core_8 += 4;
-				core_8_next += 4;
-			}
+	last_present_time = std::chrono::steady_clock::now();
+
+	for (;;) {
+		events_poll();
+
+		if (!display_running) break;
+
+		video_frame_t frame;
+		uint8_t offered = VIDEO_OFFERED;
+
+		if (video_offer.compare_exchange_strong(offered, VIDEO_UPLOADING, std::memory_order_acquire)) {
+			/*
+			 * A copy that wasn't presented yet is older, skip it
+			 */
+			if (video_copies->acquire()) skipped_frames++;
+			frame = offered_frame;
+			upload_frame(frame);
+			video_offer.store(VIDEO_IDLE, std::memory_order_release);
+		} else if (video_copies->acquire()) {
+			frame = video_copies->front().frame;
+			upload_frame(frame);
+		} else {
+			continue;
 		}
 
-		for (int x=0; x<MAX_PIXELS_PER_SCANLINE; x++) {
-			core_buffer_8[MAX_PIXELS_PER_SCANLINE * ((MAX_SCANLINES - 1) << 3) + (x << 2) + 0] = *core_8;
-			core_buffer_8[MAX_PIXELS_PER_SCANLINE * ((MAX_SCANLINES - 1) << 3) + (x << 2) + 1] = *(core_8 + 1);
-			core_buffer_8[MAX_PIXELS_PER_SCANLINE * ((MAX_SCANLINES - 1) << 3) + (x << 2) + 2] = *(core_8 + 2);
-			core_buffer_8[MAX_PIXELS_PER_SCANLINE * ((MAX_SCANLINES - 1) << 3) + (x << 2) + 3] = *(core_8 + 3);
+		render_frame(frame);
+
+		/*
+		 * Pacing statistics
+		 */
+		std::chrono::time_point<std::chrono::steady_clock> now = std::chrono::steady_clock::now();
+		double interval = (double)std::chrono::duration_cast<std::chrono::microseconds>(now - last_present_time).count() / 1000;
+		last_present_time = now;
+		double deviation = interval - (1000.0 / FPS);
+		if (deviation < 0) deviation = -deviation;
+		present_interval_ms = (0.95 * present_interval_ms) + (0.05 * interval);
+		present_jitter_ms = (0.95 * present_jitter_ms) + (0.05 * deviation);
+		presented_frames++;
+	}
+}
 
-			core_buffer_8[MAX_PIXELS_PER_SCANLINE * (((MAX_SCANLINES - 1) << 3)  + (1 << 2)) + (x << 2) + 0] = scanlines_value;
-			core_buffer_8[MAX_PIXELS_PER_SCANLINE * (((MAX_SCANLINES - 1) << 3)  + (1 << 2)) + (x << 2) + 1] = (*(core_8 + 1)) >> 1;
-			core_buffer_8[MAX_PIXELS_PER_SCANLINE * (((MAX_SCANLINES - 1) << 3)  + (1 << 2)) + (x << 2) + 2] = (*(core_8 + 2)) >> 1;
-			core_buffer_8[MAX_PIXELS_PER_SCANLINE * (((MAX_SCANLINES - 1) << 3)  + (1 << 2)) + (x << 2) + 3] = (*(core_8 + 3)) >> 1;
+void host_t::stop_display()
+{
+	display_running = false;
+	wake_display();
+}
 
-			core_8 += 4;
-			core_8_next += 4;
-		}
-	} else {
-	// simple "fake" scanlines uses alpha value for each second line
-	// // This way, the viewer in debug has transparency values...
-	// // Unless, of course, SDL_BLENDMODE_NONE will be used :-)
-		for (int y=0; y<MAX_SCANLINES; y++) {
-			for (int x=0; x<MAX_PIXELS_PER_SCANLINE; x++) {
-				core_buffer[(MAX_PIXELS_PER_SCANLINE * (y << 1)) + x] = *core;
-				core_buffer[(MAX_PIXELS_PER_SCANLINE * ((y << 1) + 1)) + x] = *core;
-				//*(uint8_t *)&core_buffer[(MAX_PIXELS_PER_SCANLINE * ((y << 1) + 1)) + x] = 160;	// 160 is an alpha value
-				core++;
-			}
-		}
-	}
+/*
+ * An empty user event ends the wait for events of the main thread
+ */
+void host_t::wake_display()
+{
+	SDL_Event event;
+	SDL_zero(event);
+	event.type = SDL_USEREVENT;
+	SDL_PushEvent(&event);
+}
 
-	SDL_UpdateTexture(core_texture, NULL, core_buffer, MAX_PIXELS_PER_SCANLINE * sizeof(uint32_t));
+/*
+ * Emulation thread side: only pointers into vram are kept, vram is left
+ * alone until video_reclaim()
+ */
+void host_t::update_core_texture(uint32_t *core)
+{
+	offered_frame.core = core;
 }
 
 void host_t::update_debugger_texture(uint32_t *debugger)
 {
-	uint8_t *debugger_8 = (uint8_t *)debugger;
-	uint8_t *debugger_8_next = debugger_8 + (MAX_PIXELS_PER_SCANLINE << 2);
-	uint8_t *debugger_buffer_8 = (uint8_t *)debugger_buffer;
-
-	if (scanlines) {
-		for (int y=0; y<(MAX_SCANLINES - 1); y++) {
-			for (int x=0; x<MAX_PIXELS_PER_SCANLINE; x++) {
-				// core line
-				debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * (y << 3) + (x << 2) + 0] = *debugger_8;
-				debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * (y << 3) + (x << 2) + 1] = *(debugger_8 + 1);
-				debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * (y << 3) + (x << 2) + 2] = *(debugger_8 + 2);
-				debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * (y << 3) + (x << 2) + 3] = *(debugger_8 + 3);
-				// odd line
-				debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * ((y << 3) + (1 << 2)) + (x << 2) + 0] = scanlines_value;
-				debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * ((y << 3) + (1 << 2)) + (x << 2) + 1] = ((*(debugger_8 + 1)) >> 1) + ((*(debugger_8_next + 1)) >> 1);
-				debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * ((y << 3) + (1 << 2)) + (x << 2) + 2] = ((*(debugger_8 + 2)) >> 1) + ((*(debugger_8_next + 2)) >> 1);
-				debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * ((y << 3) + (1 << 2)) + (x << 2) + 3] = ((*(debugger_8 + 3)) >> 1) + ((*(debugger_8_next + 3)) >> 1);
-
-				debugger_8 += 4;
-				debugger_8_next += 4;
-			}
-		}
+	offered_frame.debugger = debugger;
+	offered_frame.debugger_generation = ++debugger_generation;
+}
 
-		for (int x=0; x<MAX_PIXELS_PER_SCANLINE; x++) {
-			debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * ((MAX_SCANLINES - 1) << 3) + (x << 2) + 0] = *debugger_8;
-			debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * ((MAX_SCANLINES - 1) << 3) + (x << 2) + 1] = *(debugger_8 + 1);
-			debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * ((MAX_SCANLINES - 1) << 3) + (x << 2) + 2] = *(debugger_8 + 2);
-			debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * ((MAX_SCANLINES - 1) << 3) + (x << 2) + 3] = *(debugger_8 + 3);
+void host_t::update_screen()
+{
+	offered_frame.mode = system->current_mode;
+	offered_frame.viewer_visible = viewer_visible;
+	offered_frame.scanlines = scanlines;
 
-			debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * (((MAX_SCANLINES - 1) << 3)  + (1 << 2)) + (x << 2) + 0] = scanlines_value;
-			debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * (((MAX_SCANLINES - 1) << 3)  + (1 << 2)) + (x << 2) + 1] = (*(debugger_8 + 2)) >> 1;
-			debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * (((MAX_SCANLINES - 1) << 3)  + (1 << 2)) + (x << 2) + 2] = (*(debugger_8 + 2)) >> 1;
-			debugger_buffer_8[MAX_PIXELS_PER_SCANLINE * (((MAX_SCANLINES - 1) << 3)  + (1 << 2)) + (x << 2) + 3] = (*(debugger_8 + 3)) >> 1;
+	video_offer.store(VIDEO_OFFERED, std::memory_order_release);
+	wake_display();
+}
 
-			debugger_8 += 4;
-			debugger_8_next += 4;
+/*
+ * Takes vram back from the main thread. A frame it didn't take yet is
+ * copied into the triple buffer, a frame it is uploading is waited
+ * for (one texture upload at most).
+ */
+void host_t::video_reclaim()
+{
+	uint8_t state = VIDEO_OFFERED;
+
+	if (video_offer.compare_exchange_strong(state, VIDEO_IDLE, std::memory_order_acquire)) {
+		video_copy_t &copy = video_copies->back();
+		memcpy(copy.core, offered_frame.core, PIXELS * sizeof(uint32_t));
+		if (copy.frame.debugger_generation != offered_frame.debugger_generation) {
+			memcpy(copy.debugger, offered_frame.debugger, PIXELS * sizeof(uint32_t));
 		}
+		copy.frame = offered_frame;
+		copy.frame.core = copy.core;
+		copy.frame.debugger = copy.debugger;
+		video_copies->publish();
+		wake_display();
 	} else {
-	// simple "fake" scanlines uses alpha value for each second line
-	// // This way, the viewer in debug has transparency values...
-	// // Unless, of course, SDL_BLENDMODE_NONE will be used :-)
-		for (int y=0; y<MAX_SCANLINES; y++) {
-			for (int x=0; x<MAX_PIXELS_PER_SCANLINE; x++) {
-				debugger_buffer[(MAX_PIXELS_PER_SCANLINE * (y << 1)) + x] = *debugger;
-				debugger_buffer[(MAX_PIXELS_PER_SCANLINE * ((y << 1) + 1)) + x] = *debugger;
-				//*(uint8_t *)&debugger_buffer[(MAX_PIXELS_PER_SCANLINE * ((y << 1) + 1)) + x] = 160;	// 160 is an alpha value
-				debugger++;
-			}
+		while (state == VIDEO_UPLOADING) {
+			std::this_thread::yield();
+			state = video_offer.load(std::memory_order_acquire);
 		}
 	}
+}
 
-	SDL_UpdateTexture(debugger_texture, NULL, debugger_buffer, MAX_PIXELS_PER_SCANLINE * sizeof(uint32_t));
+/*
+ * Main thread side. Textures have the native resolution of the
+ * framebuffers, scanlines are drawn on top of them by the gpu (see
+ * render_frame()).
+ *
+ * Normally the core framebuffer is uploaded straight from vram, with
+ * the OpenGL renderers that's a single glTexSubImage2D, with Metal and
+ * Direct3D 11 a copy into staging memory plus a gpu side copy. Locking
+ * the texture instead wouldn't save a copy, the OpenGL renderers lock
+ * a shadow buffer of their own.
+ */
+void host_t::upload_frame(const video_frame_t &frame)
+{
+	if (frame.core) {
+		SDL_UpdateTexture(core_texture, NULL, frame.core, MAX_PIXELS_PER_SCANLINE * sizeof(uint32_t));
+	}
+	if (frame.debugger_generation != uploaded_debugger_generation) {
+		SDL_UpdateTexture(debugger_texture, NULL, frame.debugger, MAX_PIXELS_PER_SCANLINE * sizeof(uint32_t));
+		uploaded_debugger_generation = frame.debugger_generation;
+	}
 }
 
-void host_t::update_screen()
+void host_t::render_frame(const video_frame_t &frame)
 {
 	SDL_RenderClear(video_renderer);
 
-	switch (system->current_mode) {
+	switch (frame.mode) {
 		case DEBUG_MODE:
 			SDL_RenderCopy(video_renderer, debugger_texture, NULL, video_fullscreen ? &fullscreen_rect : NULL);
 			break;
@@ -390,7 +637,11 @@ void host_t::update_screen()
 			break;
 	}
 
-	if ((system->current_mode == DEBUG_MODE) && viewer_visible) {
+	if (frame.scanlines) {
+		SDL_RenderCopy(video_renderer, scanlines_texture, NULL, video_fullscreen ? &fullscreen_rect : NULL);
+	}
+
+	if ((frame.mode == DEBUG_MODE) && frame.viewer_visible) {
 		SDL_Rect viewer = {
 			(190 * video_scaling_fullscreen) + (video_fullscreen ? fullscreen_rect.x : 0),
 			(14 * video_scaling_fullscreen) + (video_fullscreen ? fullscreen_rect.y : 0),
@@ -416,7 +667,7 @@ void host_t::create_core_texture()
 
 	core_texture = SDL_CreateTexture(video_renderer, SDL_PIXELFORMAT_ARGB32,
 				    SDL_TEXTUREACCESS_STREAMING,
-				    MAX_PIXELS_PER_SCANLINE, 2 * MAX_SCANLINES);
+				    MAX_PIXELS_PER_SCANLINE, MAX_SCANLINES);
 
 	SDL_SetTextureBlendMode(core_texture, SDL_BLENDMODE_BLEND);
 }
@@ -427,11 +678,38 @@ void host_t::create_debugger_texture()
 
 	debugger_texture = SDL_CreateTexture(video_renderer, SDL_PIXELFORMAT_ARGB32,
 				    SDL_TEXTUREACCESS_STREAMING,
-				    MAX_PIXELS_PER_SCANLINE, 2 * MAX_SCANLINES);
+				    MAX_PIXELS_PER_SCANLINE, MAX_SCANLINES);
 
 	SDL_SetTextureBlendMode(debugger_texture, SDL_BLENDMODE_BLEND);
 }
 
+/*
+ * Static overlay, one pixel wide and two rows per scanline. Even rows
+ * are transparent, odd rows darken the image to scanlines_value.
+ * Stretched over the screen it gives the same look as the old cpu
+ * generated scanlines.
+ */
+void host_t::create_scanlines_texture()
+{
+	if (scanlines_texture) SDL_DestroyTexture(scanlines_texture);
+
+	scanlines_texture = SDL_CreateTexture(video_renderer, SDL_PIXELFORMAT_ARGB32,
+				    SDL_TEXTUREACCESS_STATIC,
+				    1, 2 * MAX_SCANLINES);
+
+	// argb32, byte order a, r, g, b
+	uint8_t overlay[2 * MAX_SCANLINES][4];
+	for (int y=0; y<(2 * MAX_SCANLINES); y++) {
+		overlay[y][0] = (y & 0b1) ? 255 - scanlines_value : 0;
+		overlay[y][1] = 0;
+		overlay[y][2] = 0;
+		overlay[y][3] = 0;
+	}
+	SDL_UpdateTexture(scanlines_texture, NULL, overlay, sizeof(uint32_t));
+
+	SDL_SetTextureBlendMode(scanlines_texture, SDL_BLENDMODE_BLEND);
+}
+
 enum events_output_state host_t::events_process_events()
 {
 	enum events_output_state return_value = NO_EVENT;
@@ -442,14 +720,11 @@ enum events_output_state host_t::events_process_events()
 	bool alt_pressed = sdl_keyboard_state[SDL_SCANCODE_LALT] | sdl_keyboard_state[SDL_SCANCODE_RALT];
 	//bool gui_pressed   = sdl2_keyboard_state[SDL_SCANCODE_LGUI] | sdl2_keyboard_state[SDL_SCANCODE_RGUI];
 
-	while (SDL_PollEvent(&event)) {
+	while (events_next(&event)) {
 		switch(event.type) {
 			case SDL_KEYDOWN:
 				return_value = KEYPRESS_EVENT;
-				if ((event.key.keysym.sym == SDLK_f) && alt_pressed) {
-					events_wait_until_key_released(SDLK_f);
-					video_toggle_fullscreen();
-				} else if ((event.key.keysym.sym == SDLK_s) && alt_pressed ) {
+				if ((event.key.keysym.sym == SDLK_s) && alt_pressed ) {
 					video_toggle_scanlines();
 				} else if ((event.key.keysym.sym == SDLK_r) && alt_pressed) {
 					events_wait_until_key_released(SDLK_r);
@@ -462,14 +737,12 @@ enum events_output_state host_t::events_process_events()
 					system->switch_mode();
 //				} else if(event.key.keysym.sym == SDLK_F10) {
 //					hud->toggle_stats();
-//				} else if((event.key.keysym.sym == SDLK_w) && alt_pressed) {
-//					// TODO: does this always work?
-//					if (settings->audio_recording) {
-//						hud->show_notification("\nStop recording sound");
-//					} else {
-//						hud->show_notification("\nStart recording sound");
-//					}
-//					settings->audio_toggle_recording();
+				} else if ((event.key.keysym.sym == SDLK_t) && alt_pressed) {
+					events_wait_until_key_released(SDLK_t);
+					system->cycle_turbo();
+				} else if ((event.key.keysym.sym == SDLK_w) && alt_pressed) {
+					events_wait_until_key_released(SDLK_w);
+					toggle_audio_recording();
 				}
 				break;
 			case SDL_DROPFILE:
@@ -594,9 +867,10 @@ void host_t::events_wait_until_key_released(SDL_KeyCode key)
 	SDL_Event event;
 	bool wait = true;
 	while (wait) {
-	    SDL_PollEvent(&event);
-	    if ((event.type == SDL_KEYUP) && (event.key.keysym.sym == key)) wait = false;
-	    std::this_thread::sleep_for(std::chrono::microseconds(40000));
+	    while (events_next(&event)) {
+		    if ((event.type == SDL_KEYUP) && (event.key.keysym.sym == key)) wait = false;
+	    }
+	    if (wait) std::this_thread::sleep_for(std::chrono::microseconds(40000));
 	}
 }
 
@@ -606,7 +880,10 @@ bool host_t::events_yes_no()
 	bool checking = true;
 	bool return_value = true;
 	while (checking) {
-		SDL_PollEvent(&event);
+		if (!events_next(&event)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			continue;
+		}
 		if (event.type == SDL_KEYDOWN) {
 			if (event.key.keysym.sym == SDLK_y) {
 				checking = false;
@@ -615,25 +892,68 @@ bool host_t::events_yes_no()
 				checking = false;
 			}
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(5));
 	}
+	video_reclaim();
 	return return_value;
 }
 
+/*
+ * Main thread: waits for events (or a wake up), toggles fullscreen
+ * itself and queues everything else for the emulation thread
+ */
+void host_t::events_poll()
+{
+	const uint8_t *state = SDL_GetKeyboardState(NULL);
+	SDL_Event event;
+
+	bool pending = SDL_WaitEventTimeout(&event, EVENT_WAIT_MS);
+
+	/*
+	 * Keyboard state goes first, so it's at least as new as the
+	 * queued events once the emulation thread reads them
+	 */
+	for (int i=0; i<SDL_NUM_SCANCODES; i++) sdl_keyboard_state[i].store(state[i], std::memory_order_relaxed);
+
+	if (!pending) return;
+
+	do {
+		if (event.type == SDL_USEREVENT) continue;
+
+		if ((event.type == SDL_KEYDOWN) && (event.key.keysym.sym == SDLK_f) &&
+		    (state[SDL_SCANCODE_LALT] || state[SDL_SCANCODE_RALT])) {
+			if (!event.key.repeat) video_toggle_fullscreen();
+			continue;
+		}
+
+		if (!event_queue.push(&event, 1) && (event.type == SDL_DROPFILE)) SDL_free(event.drop.file);
+	} while (SDL_PollEvent(&event));
+}
+
+/*
+ * Emulation thread, next queued event (if any)
+ */
+bool host_t::events_next(SDL_Event *event)
+{
+	if (!event_queue.size()) return false;
+	*event = event_queue.peek(0);
+	event_queue.discard(1);
+	return true;
+}
+
 void host_t::video_toggle_fullscreen()
 {
 	video_fullscreen = !video_fullscreen;
+	int window_width, window_height;
 	if (video_fullscreen) {
 		SDL_SetWindowFullscreen(video_window, SDL_WINDOW_FULLSCREEN_DESKTOP);
 		SDL_GetWindowSize(video_window, &window_width, &window_height);
-		SDL_RenderSetLogicalSize(video_renderer, window_width, window_height);
 		printf("[SDL] Fullscreen size: %i x %i\n", window_width, window_height);
 	} else {
 		SDL_SetWindowFullscreen(video_window, SDL_WINDOW_RESIZABLE);
 		SDL_GetWindowSize(video_window, &window_width, &window_height);
-		SDL_RenderSetLogicalSize(video_renderer, window_width, window_height);
 		printf("[SDL] Window size: %i x %i\n", window_width, window_height);
 	}
+	SDL_RenderSetLogicalSize(video_renderer, window_width, window_height);
 }
 
 void host_t::video_toggle_scanlines()
@@ -9,9 +9,29 @@
 #define HOST_HPP
 
 #include <SDL2/SDL.h>
+#include <atomic>
+#include <cstdio>
 #include "common.hpp"
+#include "recorder.hpp"
+#include "ring_buffer.hpp"
+#include "triple_buffer.hpp"
 #include "system.hpp"
 
+/*
+ * Events handed from the main thread to the emulation thread, power of
+ * two. While waiting for events the main thread wakes up at least every
+ * EVENT_WAIT_MS.
+ */
+#define EVENT_QUEUE_SIZE	256
+#define EVENT_WAIT_MS		10
+
+/*
+ * Handover of a finished frame from emulation to main thread
+ */
+#define VIDEO_IDLE		0
+#define VIDEO_OFFERED		1
+#define VIDEO_UPLOADING		2
+
 enum events_output_state {
 	QUIT_EVENT = -1,
 	NO_EVENT = 0,
@@ -94,6 +114,23 @@ enum scancodes {
 
 class host_t {
 private:
+	/*
+	 * When headless, no SDL audio and video are initialized
+	 */
+	bool headless;
+
+	/*
+	 * Optional raw dumps of audio (interleaved stereo floats at
+	 * SAMPLE_RATE) and frames (PIXELS argb32 values per frame)
+	 */
+	FILE *audio_dump{nullptr};
+	FILE *video_dump{nullptr};
+
+	/*
+	 * Wav recording, written by its own thread
+	 */
+	recorder_t recorder;
+
 	/*
 	 * Audio related
 	 */
@@ -107,49 +144,157 @@ private:
 	void audio_start();
 	void audio_stop();
 
+	/*
+	 * Emulation thread pushes stereo frames into the ring buffer,
+	 * the SDL audio callback pulls them out. A fractional resampler
+	 * in the callback absorbs drift between both clocks by running
+	 * slightly faster or slower (max AUDIO_MAX_DRIFT) depending on
+	 * the smoothed fill level of the ring buffer.
+	 */
+	struct audio_frame_t {
+		float left;
+		float right;
+	};
+	ring_buffer_t<audio_frame_t, AUDIO_RING_SIZE> audio_ring;
+	uint32_t audio_target_frames;
+	double audio_base_ratio{1.0};		// SAMPLE_RATE / device frequency
+	double audio_resample_position{0.0};
+	double audio_smoothed_fill{0.0};
+	bool audio_priming{true};		// waiting for target fill (start, underrun)
+	std::atomic<double> audio_ratio{1.0};
+	std::atomic<uint32_t> audio_underruns{0};
+	std::atomic<uint32_t> audio_overruns{0};
+
+	/*
+	 * Turbo: only the audio of one emulated frame per host frame is
+	 * kept. Stretched, the start of a kept frame crossfades with the
+	 * natural continuation of the previous one (the start of the
+	 * first dropped frame). Otherwise kept frames are silenced.
+	 */
+	bool audio_turbo{false};
+	bool audio_turbo_keep{true};
+	bool audio_turbo_stretch{true};
+	float audio_crossfade[AUDIO_TURBO_CROSSFADE][2];
+	uint32_t audio_crossfade_captured{0};
+	uint32_t audio_crossfade_position{0};
+	bool audio_turbo_filter(float *buffer, uint32_t frames);
+
+	static void audio_callback(void *userdata, Uint8 *stream, int len);
+	void audio_fill(audio_frame_t *output, int frames);
+
 	/*
 	 * Video related
 	 */
 	uint8_t video_scaling_fullscreen;
 	uint8_t video_scaling_windowed;
 	SDL_Rect fullscreen_rect;
+	int video_refresh_rate;
 	bool scanlines{true};
 	const uint8_t scanlines_value{160};
 
-	bool video_fullscreen{false};
+	bool video_fullscreen{false};	// main thread
 	SDL_Window *video_window;
-	SDL_Renderer *video_renderer;
 	bool vsync;
 
-	uint32_t *core_buffer{nullptr};
-	SDL_Texture *core_texture{nullptr};
+	bool viewer_visible{false};
 
-	uint32_t *debugger_buffer{nullptr};
-	SDL_Texture *debugger_texture{nullptr};
+	void video_init();
+	void video_stop();
 
-	bool viewer_visible{false};
+	/*
+	 * Window, renderer and events belong to the main thread (as SDL
+	 * requires on macOS), the machine runs on an emulation thread, see
+	 * system_t::run(). A finished frame is offered to the main thread
+	 * straight from vram (update_screen()), the main thread uploads it
+	 * while emulation waits for its next frame, nothing is copied.
+	 * Only when the main thread didn't take it before emulation needs
+	 * vram again (video_reclaim()), the frame is copied into a triple
+	 * buffer, so a slow present (or vsync) never stalls emulation.
+	 * Everything the main thread needs to draw a frame travels with
+	 * the frame.
+	 */
+	struct video_frame_t {
+		const uint32_t *core;
+		const uint32_t *debugger;
+		uint32_t debugger_generation;	// debugger only uploaded when redrawn
+		enum mode mode;
+		bool viewer_visible;
+		bool scanlines;
+	};
+	struct video_copy_t {
+		uint32_t core[PIXELS];
+		uint32_t debugger[PIXELS];
+		video_frame_t frame;
+	};
 
-	int window_width;
-	int window_height;
+	/*
+	 * Owner of offered_frame (and the vram it points into) is the
+	 * emulation thread when idle, the main thread when uploading
+	 */
+	std::atomic<uint8_t> video_offer{VIDEO_IDLE};
+	video_frame_t offered_frame{};
+	triple_buffer_t<video_copy_t> *video_copies{nullptr};
+	uint32_t debugger_generation{0};
 
+	std::atomic<bool> display_running{false};
+
+	/*
+	 * Owned by the main thread
+	 */
+	SDL_Renderer *video_renderer;
+	SDL_Texture *core_texture{nullptr};
+	SDL_Texture *debugger_texture{nullptr};
+	SDL_Texture *scanlines_texture{nullptr};
+	uint32_t uploaded_debugger_generation{0};
+
+	void render_init();
+	void upload_frame(const video_frame_t &frame);
+	void render_frame(const video_frame_t &frame);
+	void wake_display();
 	void create_core_texture();
 	void create_debugger_texture();
+	void create_scanlines_texture();
 
-	void video_init();
-	void video_stop();
+	/*
+	 * Frame pacing statistics (written by main thread)
+	 */
+	std::chrono::time_point<std::chrono::steady_clock> last_present_time;
+	std::atomic<double> present_interval_ms{0.0};
+	std::atomic<double> present_jitter_ms{0.0};
+	std::atomic<uint32_t> presented_frames{0};
+	std::atomic<uint32_t> skipped_frames{0};
 
 	/*
-	 * events related
+	 * events related. The main thread polls SDL, handles what
+	 * concerns the window itself and queues the rest, together with
+	 * a copy of the keyboard state, for the emulation thread.
 	 */
-	const uint8_t *sdl_keyboard_state;
+	ring_buffer_t<SDL_Event, EVENT_QUEUE_SIZE> event_queue;
+	std::atomic<uint8_t> sdl_keyboard_state[SDL_NUM_SCANCODES];
+	void events_poll();
+	bool events_next(SDL_Event *event);
 
 	char current_dir[512];
 	char *home;
 
 public:
-	host_t(system_t *s);
+	host_t(system_t *s, bool h);
 	~host_t();
 
+	inline bool is_headless() { return headless; }
+
+	bool set_audio_dump(const char *path);
+	bool set_video_dump(const char *path);
+
+	/*
+	 * Starts a wav recording, without a path a time stamped file in
+	 * the preference path is used. Headless recordings are lossless.
+	 */
+	bool start_audio_recording(const char *path = nullptr);
+	void stop_audio_recording();
+	void toggle_audio_recording();
+	inline bool is_recording_audio() { return recorder.is_recording(); }
+
 	system_t *system;
 
 	char *sdl_preference_path;
@@ -157,15 +302,55 @@ public:
 	/*
 	 * Audio related
 	 */
-	inline void queue_audio(void *buffer, unsigned size) { SDL_QueueAudio(audio_device, buffer, size); }
-	inline unsigned int get_queued_audio_size_bytes() { return SDL_GetQueuedAudioSize(audio_device); }
+	inline void queue_audio(void *buffer, unsigned size) {
+		// turbo may modify buffer in place
+		if (audio_turbo && !audio_turbo_filter((float *)buffer, size / sizeof(audio_frame_t))) return;
+		if (audio_dump) fwrite(buffer, 1, size, audio_dump);
+		if (recorder.is_recording()) recorder.push((float *)buffer, size / sizeof(audio_frame_t));
+		if (!headless) {
+			uint32_t frames = size / sizeof(audio_frame_t);
+			if (audio_ring.push((audio_frame_t *)buffer, frames) < frames) audio_overruns++;
+		}
+	}
 
 	/*
-	 * Video related
+	 * Called before each emulated frame (turbo, keep audio of this
+	 * frame, stretch or silence) and after the last one of a host
+	 * frame
+	 */
+	void set_audio_turbo_frame(bool turbo, bool keep, bool stretch);
+	inline void end_audio_turbo() { audio_turbo = false; }
+
+	/*
+	 * Latency stats: buffered audio (ring buffer plus one device
+	 * buffer), current resampling ratio and number of under/overruns
+	 */
+	inline double get_audio_latency_ms() {
+		return headless ? 0.0 : (double)(audio_ring.size() + audio_spec_have.samples) * 1000 / SAMPLE_RATE;
+	}
+	inline double get_audio_ratio() { return audio_ratio; }
+	inline uint32_t get_audio_underruns() { return audio_underruns; }
+	inline uint32_t get_audio_overruns() { return audio_overruns; }
+
+	/*
+	 * Main thread, polls events and presents frames until the
+	 * emulation thread calls stop_display()
+	 */
+	void run_display();
+	void stop_display();
+
+	/*
+	 * Video related (emulation thread), update_screen() offers the
+	 * frame to the main thread. Before vram is written again,
+	 * video_reclaim() has to be called.
 	 */
 	void update_core_texture(uint32_t *core);
+	inline void dump_core_frame(uint32_t *core) {
+		if (video_dump) fwrite(core, sizeof(uint32_t), PIXELS, video_dump);
+	}
 	void update_debugger_texture(uint32_t *debugger);
 	void update_screen();
+	void video_reclaim();
 
 	void video_toggle_fullscreen();
 	void video_toggle_scanlines();
@@ -175,11 +360,21 @@ public:
 
 	inline bool vsync_enabled() { return vsync; }
 	inline bool vsync_disabled() { return !vsync; }
+
+	/*
+	 * Frame pacing: smoothed time between presents, smoothed deviation
+	 * from the emulated frame time, and frames that were replaced by
+	 * a newer one before they could be presented
+	 */
+	inline double get_present_interval_ms() { return present_interval_ms; }
+	inline double get_present_jitter_ms() { return present_jitter_ms; }
+	inline uint32_t get_presented_frames() { return presented_frames; }
+	inline uint32_t get_dropped_frames() { return video_copies ? video_copies->get_replaced() + skipped_frames : 0; }
 	inline uint8_t get_bytes_per_sample() { return audio_bytes_per_sample; }
 	inline double get_bytes_per_ms() { return audio_bytes_per_ms; }
 
 	/*
-	 * Events related
+	 * Events related (emulation thread)
 	 */
 	enum events_output_state events_process_events();
 	uint8_t keyboard_state[128];
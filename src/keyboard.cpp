@@ -295,3 +295,31 @@ void keyboard_t::io_write8(uint16_t address, uint8_t value)
 			break;
 	}
 }
+
+void keyboard_t::save_state(state_t *s)
+{
+	s->put(generate_events);
+	s->put(key_down);
+	s->put(microseconds_remaining);
+	s->put(time_to_next);
+	s->put(repeat_delay_ms);
+	s->put(repeat_speed_ms);
+	s->put(last_char);
+	s->put_bytes(event_list, sizeof(event_list));
+	s->put(head);
+	s->put(tail);
+}
+
+void keyboard_t::load_state(state_t *s)
+{
+	s->get(generate_events);
+	s->get(key_down);
+	s->get(microseconds_remaining);
+	s->get(time_to_next);
+	s->get(repeat_delay_ms);
+	s->get(repeat_speed_ms);
+	s->get(last_char);
+	s->get_bytes(event_list, sizeof(event_list));
+	s->get(head);
+	s->get(tail);
+}
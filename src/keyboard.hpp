@@ -12,6 +12,7 @@
 #include "system.hpp"
 #include "common.hpp"
 #include "host.hpp"
+#include "state.hpp"
 
 class keyboard_t {
 private:
@@ -52,6 +53,9 @@ public:
 	
 	uint8_t io_read8(uint16_t address);
 	void io_write8(uint16_t address, uint8_t value);
+
+	void save_state(state_t *s);
+	void load_state(state_t *s);
 };
 
 #endif
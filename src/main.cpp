@@ -6,15 +6,130 @@
  */
 
 #include "system.hpp"
+#include "host.hpp"
+#include "core.hpp"
+#include "runner.hpp"
+#include "rewind.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void usage(const char *name)
+{
+	printf("usage: %s [options]\n"
+	       "  --headless        no audio, video and events, run unthrottled\n"
+	       "  --frames <n>      stop after n frames (headless only)\n"
+	       "  --dump-audio <f>  write audio to file (raw stereo 32 bit float)\n"
+	       "  --dump-video <f>  write frames to file (raw argb32)\n"
+	       "  --record <f>      record audio to wav file (lossless when headless)\n"
+	       "  --instances <n>   run n independent machines in parallel (headless only)\n"
+	       "  --threads <n>     number of worker threads for --instances (default: all cores)\n"
+	       "  --parallel-sound  clock the four sids on worker threads\n"
+	       "  --turbo <n>       run 1, 2, 4 or max frames per displayed frame (alt-t cycles)\n"
+	       "  --turbo-mute      silence audio in turbo mode instead of time stretching\n"
+	       "  --load-state <f>  start from a machine state file\n"
+	       "  --save-state <f>  write a machine state file on exit\n"
+	       "  --rewind <s> <mb> keep s seconds of frames to rewind in at most mb megabytes (default off)\n", name);
+}
 
 int main(int argc, char **argv)
 {
-	// for (int i = 0; i < argc; i++) {
-	// 	printf("%s\n", argv[i]);
-	// }
+	bool headless = false;
+	uint32_t frames = 0;
+	const char *audio_dump = NULL;
+	const char *video_dump = NULL;
+	const char *record = NULL;
+	uint32_t instances = 1;
+	uint32_t threads = 0;
+	bool parallel_sound = false;
+	uint32_t turbo = 1;
+	bool turbo_mute = false;
+	const char *load_state = NULL;
+	const char *save_state = NULL;
+	uint32_t rewind_seconds = REWIND_DEFAULT_SECONDS;
+	uint32_t rewind_mb = REWIND_DEFAULT_MB;
+	bool rewind_set = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			headless = true;
+		} else if ((strcmp(argv[i], "--frames") == 0) && (i + 1 < argc)) {
+			frames = strtoul(argv[++i], NULL, 10);
+		} else if ((strcmp(argv[i], "--dump-audio") == 0) && (i + 1 < argc)) {
+			audio_dump = argv[++i];
+		} else if ((strcmp(argv[i], "--dump-video") == 0) && (i + 1 < argc)) {
+			video_dump = argv[++i];
+		} else if ((strcmp(argv[i], "--record") == 0) && (i + 1 < argc)) {
+			record = argv[++i];
+		} else if ((strcmp(argv[i], "--instances") == 0) && (i + 1 < argc)) {
+			instances = strtoul(argv[++i], NULL, 10);
+		} else if ((strcmp(argv[i], "--threads") == 0) && (i + 1 < argc)) {
+			threads = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--parallel-sound") == 0) {
+			parallel_sound = true;
+		} else if ((strcmp(argv[i], "--turbo") == 0) && (i + 1 < argc)) {
+			i++;
+			turbo = (strcmp(argv[i], "max") == 0) ? TURBO_MAX : strtoul(argv[i], NULL, 10);
+			if ((turbo != TURBO_MAX) && (turbo != 1) && (turbo != 2) && (turbo != 4)) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--turbo-mute") == 0) {
+			turbo_mute = true;
+		} else if ((strcmp(argv[i], "--load-state") == 0) && (i + 1 < argc)) {
+			load_state = argv[++i];
+		} else if ((strcmp(argv[i], "--save-state") == 0) && (i + 1 < argc)) {
+			save_state = argv[++i];
+		} else if ((strcmp(argv[i], "--rewind") == 0) && (i + 2 < argc)) {
+			rewind_seconds = strtoul(argv[++i], NULL, 10);
+			rewind_mb = strtoul(argv[++i], NULL, 10);
+			rewind_set = true;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (instances > 1) {
+		if (!headless) {
+			printf("--instances needs --headless\n");
+			return 1;
+		}
+		if (parallel_sound || (turbo != 1) || turbo_mute || rewind_set) {
+			printf("--instances can't be combined with --parallel-sound, --turbo, --turbo-mute and --rewind\n");
+			return 1;
+		}
+		runner_t runner(instances, threads);
+		if (audio_dump) runner.set_audio_dump(audio_dump);
+		if (video_dump) runner.set_video_dump(video_dump);
+		if (record) runner.set_record(record);
+		if (load_state) runner.set_load_state(load_state);
+		if (save_state) runner.set_save_state(save_state);
+		return runner.run(frames) ? 0 : 1;
+	}
+
+	system_t *system = new system_t(headless);
+
+	if (audio_dump) system->host->set_audio_dump(audio_dump);
+	if (video_dump) system->host->set_video_dump(video_dump);
+	if (record) system->host->start_audio_recording(record);
+	if (parallel_sound) system->core->sound->set_parallel(true);
+	system->turbo = turbo;
+	system->turbo_audio_stretch = !turbo_mute;
+	system->rewind_buffer->configure(rewind_seconds, rewind_mb);
+	if (load_state && !system->load_state(load_state)) {
+		delete system;
+		return 1;
+	}
+
+	if (headless) {
+		system->run_headless(frames);
+	} else {
+		system->run();
+	}
+
+	if (save_state) system->save_state(save_state);
 
-	system_t *system = new system_t();
-	system->run();
 	delete system;
 	return 0;
 }
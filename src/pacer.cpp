@@ -0,0 +1,57 @@
+/*
+ * pacer.cpp
+ * punch
+ *
+ * Copyright © 2025 elmerucr. All rights reserved.
+ */
+
+#include "pacer.hpp"
+#include <thread>
+
+pacer_t::pacer_t()
+{
+	smoothed_oversleep_us = 1000;
+	peak_oversleep_us = 1000;
+	smoothed_spin_us = 0;
+	smoothed_lateness_us = 0;
+}
+
+bool pacer_t::wait_until(std::chrono::time_point<std::chrono::steady_clock> target)
+{
+	std::chrono::time_point<std::chrono::steady_clock> now = std::chrono::steady_clock::now();
+	if (now >= target) return false;
+
+	/*
+	 * Sleep part, wake up early by the expected oversleep
+	 */
+	double margin = peak_oversleep_us > smoothed_oversleep_us ? peak_oversleep_us : smoothed_oversleep_us;
+	margin += PACER_MIN_MARGIN_US;
+	if (margin > PACER_MAX_MARGIN_US) margin = PACER_MAX_MARGIN_US;
+
+	std::chrono::time_point<std::chrono::steady_clock> wake_up = target - std::chrono::microseconds((int64_t)margin);
+
+	if (wake_up > now) {
+		std::this_thread::sleep_until(wake_up);
+		now = std::chrono::steady_clock::now();
+
+		double oversleep = (double)std::chrono::duration_cast<std::chrono::microseconds>(now - wake_up).count();
+		if (oversleep < 0) oversleep = 0;
+		smoothed_oversleep_us = (0.9 * smoothed_oversleep_us) + (0.1 * oversleep);
+		peak_oversleep_us = oversleep > peak_oversleep_us ? oversleep : 0.99 * peak_oversleep_us;
+	}
+
+	/*
+	 * Spin part
+	 */
+	std::chrono::time_point<std::chrono::steady_clock> spin_start = now;
+	while (now < target) {
+		now = std::chrono::steady_clock::now();
+	}
+
+	double spin = (double)std::chrono::duration_cast<std::chrono::microseconds>(now - spin_start).count();
+	double lateness = (double)std::chrono::duration_cast<std::chrono::microseconds>(now - target).count();
+	smoothed_spin_us = (0.9 * smoothed_spin_us) + (0.1 * spin);
+	smoothed_lateness_us = (0.9 * smoothed_lateness_us) + (0.1 * lateness);
+
+	return true;
+}
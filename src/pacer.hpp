@@ -0,0 +1,44 @@
+/*
+ * pacer.hpp
+ * punch
+ *
+ * Copyright © 2025 elmerucr. All rights reserved.
+ */
+
+#ifndef PACER_HPP
+#define PACER_HPP
+
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Waits until a moment in time with better precision than a plain
+ * sleep_until. The os sleeps for most of the interval, the remainder is
+ * spent spinning. How early to wake up follows from the measured
+ * oversleep of earlier sleeps (smoothed, plus the worst case seen
+ * recently), so on a quiet system hardly any time is spent spinning.
+ */
+#define PACER_MIN_MARGIN_US	200	// always spin the last part
+#define PACER_MAX_MARGIN_US	4000
+
+class pacer_t {
+public:
+	pacer_t();
+
+	/*
+	 * Returns false when target was already in the past
+	 */
+	bool wait_until(std::chrono::time_point<std::chrono::steady_clock> target);
+
+	inline double get_oversleep_us() { return smoothed_oversleep_us; }
+	inline double get_spin_us() { return smoothed_spin_us; }
+	inline double get_lateness_us() { return smoothed_lateness_us; }
+
+private:
+	double smoothed_oversleep_us;
+	double peak_oversleep_us;	// decays slowly
+	double smoothed_spin_us;
+	double smoothed_lateness_us;	// wake up after target (after spinning)
+};
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * recorder.cpp
+ * punch
+ *
+ * Copyright © 2025 elmerucr. All rights reserved.
+ */
+
+#include "recorder.hpp"
+#include <chrono>
+
+recorder_t::~recorder_t()
+{
+	stop();
+}
+
+bool recorder_t::start(const char *path, bool l)
+{
+	stop();
+
+	file = fopen(path, "wb");
+	if (!file) {
+		printf("[recorder] error: can't open '%s'\n", path);
+		return false;
+	}
+
+	lossless = l;
+	data_bytes = 0;
+	dropped_frames = 0;
+
+	// placeholder, sizes are filled in by stop()
+	write_header();
+
+	writer_running = true;
+	writer = std::thread(&recorder_t::write_loop, this);
+
+	printf("[recorder] recording audio to '%s' (wav, stereo, 32 bit float, %i Hz)\n", path, SAMPLE_RATE);
+	return true;
+}
+
+void recorder_t::stop()
+{
+	if (!file) return;
+
+	writer_running = false;
+	writer.join();
+
+	// writer is gone, take care of the remaining frames
+	write_available();
+
+	fseek(file, 0, SEEK_SET);
+	write_header();
+	fclose(file);
+	file = nullptr;
+
+	printf("[recorder] stopped, %u bytes of audio", data_bytes);
+	if (dropped_frames) printf(", %u frames dropped", (uint32_t)dropped_frames);
+	printf("\n");
+}
+
+void recorder_t::push(const float *frames, uint32_t n)
+{
+	const frame_t *f = (const frame_t *)frames;
+
+	uint32_t pushed = ring.push(f, n);
+
+	if (lossless) {
+		while (pushed < n) {
+			std::this_thread::sleep_for(std::chrono::microseconds(500));
+			pushed += ring.push(&f[pushed], n - pushed);
+		}
+	} else if (pushed < n) {
+		dropped_frames += n - pushed;
+	}
+}
+
+void recorder_t::write_loop()
+{
+	while (writer_running) {
+		write_available();
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+void recorder_t::write_available()
+{
+	frame_t block[RECORDER_BLOCK_SIZE];
+
+	uint32_t available;
+	while ((available = ring.size()) > 0) {
+		uint32_t n = available > RECORDER_BLOCK_SIZE ? RECORDER_BLOCK_SIZE : available;
+		for (uint32_t i=0; i<n; i++) {
+			block[i] = ring.peek(i);
+		}
+		ring.discard(n);
+
+		/*
+		 * Samples are written in host byte order, wav expects little
+		 * endian (all supported hosts are)
+		 */
+		data_bytes += fwrite(block, sizeof(frame_t), n, file) * sizeof(frame_t);
+	}
+}
+
+static void write_le(FILE *f, uint32_t value, int bytes)
+{
+	for (int i=0; i<bytes; i++) {
+		fputc((value >> (8 * i)) & 0xff, f);
+	}
+}
+
+void recorder_t::write_header()
+{
+	fwrite("RIFF", 1, 4, file);
+	write_le(file, 36 + data_bytes, 4);
+	fwrite("WAVE", 1, 4, file);
+
+	fwrite("fmt ", 1, 4, file);
+	write_le(file, 16, 4);				// chunk size
+	write_le(file, 3, 2);				// format: ieee float
+	write_le(file, 2, 2);				// channels
+	write_le(file, SAMPLE_RATE, 4);
+	write_le(file, SAMPLE_RATE * sizeof(frame_t), 4);	// bytes per second
+	write_le(file, sizeof(frame_t), 2);		// block align
+	write_le(file, 8 * sizeof(float), 2);		// bits per sample
+
+	fwrite("data", 1, 4, file);
+	write_le(file, data_bytes, 4);
+}
@@ -0,0 +1,65 @@
+/*
+ * recorder.hpp
+ * punch
+ *
+ * Copyright © 2025 elmerucr. All rights reserved.
+ */
+
+#ifndef RECORDER_HPP
+#define RECORDER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include "common.hpp"
+#include "ring_buffer.hpp"
+
+#define RECORDER_RING_SIZE	65536	// stereo frames, power of two (> 1 second)
+#define RECORDER_BLOCK_SIZE	4096	// stereo frames per fwrite
+
+/*
+ * Records the mixed stereo output to a wav file (32 bit float). The
+ * emulation thread only copies frames into a lock-free ring buffer, a
+ * writer thread takes care of the disk. In lossless mode (headless) the
+ * producer waits for the writer when the ring buffer is full, so a
+ * recording is always complete and deterministic. Otherwise frames that
+ * don't fit are dropped and counted.
+ */
+class recorder_t {
+public:
+	recorder_t() {}
+	~recorder_t();
+
+	bool start(const char *path, bool lossless);
+	void stop();
+
+	inline bool is_recording() { return file != nullptr; }
+	inline uint32_t get_dropped_frames() { return dropped_frames; }
+
+	/*
+	 * Producer side, n stereo frames (interleaved left/right)
+	 */
+	void push(const float *frames, uint32_t n);
+
+private:
+	struct frame_t {
+		float left;
+		float right;
+	};
+	ring_buffer_t<frame_t, RECORDER_RING_SIZE> ring;
+
+	FILE *file{nullptr};
+	bool lossless{false};
+	uint32_t data_bytes{0};
+	std::atomic<uint32_t> dropped_frames{0};
+
+	std::thread writer;
+	std::atomic<bool> writer_running{false};
+	void write_loop();
+	void write_available();
+
+	void write_header();
+};
+
+#endif
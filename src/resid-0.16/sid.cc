@@ -277,6 +277,11 @@ SID::State::State()
     envelope_state[i] = EnvelopeGenerator::RELEASE;
     hold_zero[i] = true;
   }
+
+  filter_Vhp = filter_Vbp = filter_Vlp = filter_Vnf = 0;
+  extfilt_Vlp = extfilt_Vhp = extfilt_Vo = 0;
+  sample_offset = 0;
+  sample_prev = 0;
 }
 
 
@@ -336,6 +341,16 @@ SID::State SID::read_state()
     state.hold_zero[i] = voice[i].envelope.hold_zero;
   }
 
+  state.filter_Vhp = filter.Vhp;
+  state.filter_Vbp = filter.Vbp;
+  state.filter_Vlp = filter.Vlp;
+  state.filter_Vnf = filter.Vnf;
+  state.extfilt_Vlp = extfilt.Vlp;
+  state.extfilt_Vhp = extfilt.Vhp;
+  state.extfilt_Vo = extfilt.Vo;
+  state.sample_offset = sample_offset;
+  state.sample_prev = sample_prev;
+
   return state;
 }
 
@@ -365,6 +380,16 @@ void SID::write_state(const State& state)
     voice[i].envelope.state = state.envelope_state[i];
     voice[i].envelope.hold_zero = state.hold_zero[i];
   }
+
+  filter.Vhp = state.filter_Vhp;
+  filter.Vbp = state.filter_Vbp;
+  filter.Vlp = state.filter_Vlp;
+  filter.Vnf = state.filter_Vnf;
+  extfilt.Vlp = state.extfilt_Vlp;
+  extfilt.Vhp = state.extfilt_Vhp;
+  extfilt.Vo = state.extfilt_Vo;
+  sample_offset = state.sample_offset;
+  sample_prev = state.sample_prev;
 }
 
 
@@ -72,6 +72,18 @@ public:
     reg8 envelope_counter[3];
     EnvelopeGenerator::State envelope_state[3];
     bool hold_zero[3];
+
+    // Filter integrators and sample clock (not in the original reSID
+    // state, needed to restore a snapshot without a transient).
+    sound_sample filter_Vhp;
+    sound_sample filter_Vbp;
+    sound_sample filter_Vlp;
+    sound_sample filter_Vnf;
+    sound_sample extfilt_Vlp;
+    sound_sample extfilt_Vhp;
+    sound_sample extfilt_Vo;
+    cycle_count sample_offset;
+    short sample_prev;
   };
     
   State read_state();
@@ -0,0 +1,99 @@
+/*
+ * rewind.cpp
+ * punch
+ *
+ * Copyright © 2025 elmerucr. All rights reserved.
+ */
+
+#include "rewind.hpp"
+#include "common.hpp"
+#include "system.hpp"
+#include "core.hpp"
+
+rewind_t::rewind_t(system_t *s)
+{
+	system = s;
+	snapshot = new snapshot_t(system);
+	configure(REWIND_DEFAULT_SECONDS, REWIND_DEFAULT_MB);
+}
+
+rewind_t::~rewind_t()
+{
+	clear();
+	if (frames) delete [] frames;
+	delete snapshot;
+}
+
+void rewind_t::configure(uint32_t seconds, uint32_t megabytes)
+{
+	clear();
+	if (frames) delete [] frames;
+
+	size = (seconds * FPS) + 1;	// one more to step back from
+	frames = new state_t *[size];
+	budget = (size_t)megabytes << 20;
+}
+
+void rewind_t::clear()
+{
+	while (count) drop_oldest();
+	first = 0;
+}
+
+void rewind_t::drop_oldest()
+{
+	state_t *oldest = frame(0);
+	bytes -= oldest->get_capacity();
+	delete oldest;
+	first = (first + 1) % size;
+	count--;
+}
+
+void rewind_t::capture()
+{
+	if (!budget) return;
+
+	/*
+	 * The very first one is a full snapshot, it fills the reference
+	 * copy of vram
+	 */
+	state_t *state = new state_t;
+	snapshot->take(state, STATE_INCREMENTAL);
+	capture_ms = (0.95 * capture_ms) + (0.05 * snapshot->get_duration_ms());
+
+	if (count == size) drop_oldest();
+	frame(count) = state;
+	count++;
+	bytes += state->get_capacity();
+
+	while ((bytes > budget) && (count > 1)) drop_oldest();
+
+	newest_ticks = system->core->cpu->clock_ticks();
+}
+
+bool rewind_t::advanced()
+{
+	return system->core->cpu->clock_ticks() != newest_ticks;
+}
+
+uint32_t rewind_t::step_back(uint32_t n)
+{
+	uint32_t done = 0;
+
+	if (n && count && advanced()) {
+		if (!snapshot->revert(frame(count - 1))) return 0;
+		done++;
+	}
+
+	while ((done < n) && (count > 1)) {
+		if (!snapshot->step_back(frame(count - 1), frame(count - 2))) break;
+		bytes -= frame(count - 1)->get_capacity();
+		delete frame(count - 1);
+		count--;
+		done++;
+	}
+
+	newest_ticks = system->core->cpu->clock_ticks();
+
+	return done;
+}
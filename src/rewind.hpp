@@ -0,0 +1,85 @@
+/*
+ * rewind.hpp
+ * punch
+ *
+ * Copyright © 2025 elmerucr. All rights reserved.
+ */
+
+#ifndef REWIND_HPP
+#define REWIND_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include "state.hpp"
+
+/*
+ * Off unless asked for (e.g. --rewind 10 64), capturing costs every
+ * frame in run mode, whether the debugger is used or not
+ */
+#define REWIND_DEFAULT_SECONDS	0
+#define REWIND_DEFAULT_MB	0
+
+/*
+ * Keeps the last frames as incremental snapshots (xor/rle deltas of
+ * the vram pages that changed, plus the rest of the machine state) so
+ * the debugger can step backwards in time. Oldest frames are dropped
+ * when either the number of frames or the memory budget is exceeded.
+ * Uses its own snapshot_t, so the reference copy of vram (16 MB) comes
+ * on top of the budget.
+ */
+class rewind_t {
+public:
+	rewind_t(system_t *s);
+	~rewind_t();
+
+	/*
+	 * A budget of 0 MB disables rewinding
+	 */
+	void configure(uint32_t seconds, uint32_t megabytes);
+	void clear();
+
+	/*
+	 * After each emulated frame
+	 */
+	void capture();
+
+	/*
+	 * Returns the number of frames actually stepped back. When the
+	 * machine ran since the newest frame (e.g. up to a breakpoint),
+	 * the first step goes back to that frame, which is kept.
+	 */
+	uint32_t step_back(uint32_t frames);
+
+	inline bool enabled() { return budget > 0; }
+	inline uint32_t frames_available() { return count ? count - 1 + (advanced() ? 1 : 0) : 0; }
+	inline size_t get_bytes() { return bytes; }
+	inline double get_capture_ms() { return capture_ms; }
+
+private:
+	system_t *system;
+	snapshot_t *snapshot;
+
+	/*
+	 * Ring of frames, oldest at index first
+	 */
+	state_t **frames{nullptr};
+	uint32_t size{0};
+	uint32_t first{0};
+	uint32_t count{0};
+
+	size_t bytes{0};	// allocated by the frames
+	size_t budget{0};
+
+	double capture_ms{0};	// smoothed
+
+	/*
+	 * Cpu clock at the newest frame, after a capture or step back
+	 */
+	uint32_t newest_ticks{0};
+	bool advanced();
+
+	void drop_oldest();
+	inline state_t *&frame(uint32_t i) { return frames[(first + i) % size]; }
+};
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * ring_buffer.hpp
+ * punch
+ *
+ * Copyright © 2025 elmerucr. All rights reserved.
+ */
+
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Lock-free single producer, single consumer ring buffer. The producer
+ * only moves head, the consumer only moves tail. SIZE must be a power
+ * of two, indices are free running and masked on access.
+ */
+template <typename T, uint32_t SIZE>
+class ring_buffer_t {
+	static_assert((SIZE & (SIZE - 1)) == 0, "ring buffer size must be a power of two");
+
+private:
+	T buffer[SIZE];
+	std::atomic<uint32_t> head{0};
+	std::atomic<uint32_t> tail{0};
+
+public:
+	/*
+	 * Producer side, returns number of elements actually stored
+	 */
+	uint32_t push(const T *data, uint32_t n) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		uint32_t free = SIZE - (h - tail.load(std::memory_order_acquire));
+		if (n > free) n = free;
+		for (uint32_t i=0; i<n; i++) {
+			buffer[(h + i) & (SIZE - 1)] = data[i];
+		}
+		head.store(h + n, std::memory_order_release);
+		return n;
+	}
+
+	/*
+	 * Consumer side: look at an element without removing it, and
+	 * remove a number of elements
+	 */
+	inline const T &peek(uint32_t i) const {
+		return buffer[(tail.load(std::memory_order_relaxed) + i) & (SIZE - 1)];
+	}
+
+	inline void discard(uint32_t n) {
+		tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+	}
+
+	/*
+	 * Number of elements available, safe from both sides
+	 */
+	inline uint32_t size() const {
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+
+	inline uint32_t capacity() const { return SIZE; }
+};
+
+#endif
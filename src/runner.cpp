@@ -0,0 +1,92 @@
+/*
+ * runner.cpp
+ * punch
+ *
+ * Copyright © 2023-2025 elmerucr. All rights reserved.
+ */
+
+#include "runner.hpp"
+#include "system.hpp"
+#include "host.hpp"
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+runner_t::runner_t(uint32_t i, uint32_t t)
+{
+	instances = i ? i : 1;
+
+	threads = t ? t : std::thread::hardware_concurrency();
+	if (threads == 0) threads = 1;
+	if (threads > instances) threads = instances;
+}
+
+bool runner_t::run(uint32_t frames)
+{
+	char path[1024];
+
+	for (uint32_t instance=0; instance<instances; instance++) {
+		system_t *system = new system_t(true);
+		machines.push_back(system);
+
+		if (audio_dump) {
+			snprintf(path, 1024, "%s.%u", audio_dump, instance);
+			system->host->set_audio_dump(path);
+		}
+		if (video_dump) {
+			snprintf(path, 1024, "%s.%u", video_dump, instance);
+			system->host->set_video_dump(path);
+		}
+		if (record) {
+			snprintf(path, 1024, "%s.%u", record, instance);
+			system->host->start_audio_recording(path);
+		}
+		if (load_state && !system->load_state(load_state)) {
+			for (system_t *s : machines) delete s;
+			machines.clear();
+			return false;
+		}
+
+		system->start_headless();
+	}
+
+	printf("[runner] %u instance(s) on %u thread(s)\n", instances, threads);
+
+	std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> pool;
+	for (uint32_t i=0; i<threads; i++) {
+		pool.emplace_back(&runner_t::worker, this, i, frames);
+	}
+	for (std::thread &t : pool) {
+		t.join();
+	}
+
+	double seconds = (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000000;
+	printf("[runner] %u x %u frames in %.2f seconds (%.1f frames/s total)\n",
+	       instances, frames, seconds, instances * frames / seconds);
+
+	for (uint32_t instance=0; instance<instances; instance++) {
+		if (save_state) {
+			snprintf(path, 1024, "%s.%u", save_state, instance);
+			machines[instance]->save_state(path);
+		}
+		delete machines[instance];
+	}
+	machines.clear();
+
+	return true;
+}
+
+/*
+ * Steps instances first, first + threads, first + 2 * threads, ...
+ */
+void runner_t::worker(uint32_t first, uint32_t frames)
+{
+	for (uint32_t frame=0; (frames == 0) || (frame < frames); frame++) {
+		for (uint32_t instance=first; instance<instances; instance+=threads) {
+			machines[instance]->run_headless_frame();
+		}
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * runner.hpp
+ * punch
+ *
+ * Copyright © 2023-2025 elmerucr. All rights reserved.
+ */
+
+#ifndef RUNNER_HPP
+#define RUNNER_HPP
+
+#include <cstdint>
+#include <vector>
+
+class system_t;
+
+/*
+ * Runs a number of independent headless machines in parallel on a small
+ * pool of worker threads. Every worker owns a fixed share of the
+ * machines and steps them round robin, one frame each, so all machines
+ * progress together, also when they run forever. Machines are created
+ * up front, after that a machine is only ever touched by its own
+ * worker, no locking is needed. Read-only data
+ * (rom, fonts, sid tables) is shared by all of them.
+ */
+class runner_t {
+public:
+	runner_t(uint32_t instances, uint32_t threads);
+
+	/*
+	 * Dumps, recordings and saved states get the instance number
+	 * appended, e.g. 'audio.raw.3'. A loaded state is the start of
+	 * all instances.
+	 */
+	void set_audio_dump(const char *path) { audio_dump = path; }
+	void set_video_dump(const char *path) { video_dump = path; }
+	void set_record(const char *path) { record = path; }
+	void set_load_state(const char *path) { load_state = path; }
+	void set_save_state(const char *path) { save_state = path; }
+
+	/*
+	 * Runs all instances for a number of frames, returns when all
+	 * of them have finished. When frames is 0, they run forever.
+	 * Returns false when the state can't be loaded.
+	 */
+	bool run(uint32_t frames);
+
+private:
+	uint32_t instances;
+	uint32_t threads;
+
+	const char *audio_dump{nullptr};
+	const char *video_dump{nullptr};
+	const char *record{nullptr};
+	const char *load_state{nullptr};
+	const char *save_state{nullptr};
+
+	std::vector<system_t *> machines;
+
+	void worker(uint32_t first, uint32_t frames);
+};
+
+#endif
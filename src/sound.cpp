@@ -113,24 +113,83 @@ sound_ic::sound_ic(system_t *s) : analog0(0), analog1(1), analog2(2), analog3(3)
 	}
 
 	/*
-	 * reset cycle counters for sid chips
+	 * reset cycle counter and master sample clock (in sync with the
+	 * sids, set_sampling_parameters() sets their offset to zero)
 	 */
-	delta_t_sid0 = 0;
-	delta_t_sid1 = 0;
-	delta_t_sid2 = 0;
-	delta_t_sid3 = 0;
+	delta_t = 0;
+	sample_offset = 0;
+	cycles_per_sample = (cycle_count)((double)SID_CLOCK_SPEED / SAMPLE_RATE * (1 << 16) + 0.5);
+
+	for (int i=0; i<4; i++) {
+		sid_pending[i] = 0;
+		sid_quality[i] = SAMPLE_FAST;
+		sid_silent[i] = false;
+		sid_quiet_cycles[i] = 0;
+		sid_skipped_cycles[i] = 0;
+	}
+
+	for (int i=0; i<128; i++) {
+		sid_shadow[i] = 0;
+	}
 
 	/*
 	 * silence all balance registers
 	 */
 	for (int i=0; i<0x10; i++) {
 		balance_registers[i] = 0x00;
+		mixer_gain[i] = 0.0;
 	}
 }
 
 sound_ic::~sound_ic()
 {
-	// nothing
+	set_parallel(false);
+}
+
+void sound_ic::set_parallel(bool p)
+{
+	if (p == parallel) return;
+
+	if (p) {
+		sid_workers_quit = false;
+		for (int i=0; i<3; i++) {
+			sid_workers[i] = std::thread(&sound_ic::sid_worker, this, i + 1);
+		}
+	} else {
+		{
+			std::lock_guard<std::mutex> lock(sid_worker_mutex);
+			sid_workers_quit = true;
+		}
+		sid_worker_start.notify_all();
+		for (int i=0; i<3; i++) {
+			sid_workers[i].join();
+		}
+	}
+
+	parallel = p;
+	printf("[sound] sids clocked %s\n", parallel ? "in parallel" : "sequentially");
+}
+
+void sound_ic::sid_worker(int i)
+{
+	uint32_t generation = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(sid_worker_mutex);
+			sid_worker_start.wait(lock, [&] { return sid_workers_quit || (sid_worker_generation != generation); });
+			if (sid_workers_quit) return;
+			generation = sid_worker_generation;
+		}
+
+		clock_sid(i);
+
+		{
+			std::lock_guard<std::mutex> lock(sid_worker_mutex);
+			sid_workers_busy--;
+		}
+		sid_worker_done.notify_one();
+	}
 }
 
 uint8_t sound_ic::io_read_byte(uint16_t address)
@@ -138,6 +197,7 @@ uint8_t sound_ic::io_read_byte(uint16_t address)
 	switch (address & 0x100) {
 		case 0x000:
 			// sids
+			if (!(address & 0x80)) wake_sid((address & 0x60) >> 5);
 			switch (address & 0x1c) {
 				case 0x1c:
 					switch (address & 0x60) {
@@ -203,6 +263,27 @@ uint8_t sound_ic::io_read_byte(uint16_t address)
 					}
 				case 0x90:
 					return balance_registers[address & 0x0f];
+				case 0xa0:
+					switch (address & 0x0f) {
+						case 0x00:
+						case 0x01:
+						case 0x02:
+						case 0x03:
+							return sid_quality[address & 0x03];
+						case 0x04:
+							return
+								(sid_silent[0] ? 0b0001 : 0b0) |
+								(sid_silent[1] ? 0b0010 : 0b0) |
+								(sid_silent[2] ? 0b0100 : 0b0) |
+								(sid_silent[3] ? 0b1000 : 0b0) ;
+						default:
+							return 0x00;
+					}
+				case 0xc0:
+				case 0xd0:
+				case 0xe0:
+				case 0xf0:
+					return delay[(address & 0x38) >> 3].read_byte(address & 0x07);
 				default:
 					return 0x00;
 			}
@@ -216,6 +297,7 @@ void sound_ic::io_write_byte(uint16_t address, uint8_t byte)
 	switch (address & 0x100) {
 		case 0x000:
 			// sids
+			wake_sid((address & 0x60) >> 5);
 			switch (address & 0x60) {
 				case 0x00:
 					sid[0].write(register_index[address & 0x1f], byte);
@@ -271,6 +353,45 @@ void sound_ic::io_write_byte(uint16_t address, uint8_t byte)
 					break;
 				case 0x90:
 					balance_registers[address & 0x0f] = byte;
+					/*
+					 * Output of both sids and analogs is int16_t
+					 * (-32768,32767). Balance registers are 0-255.
+					 * So if divided by 32768 * 255, maximum (float)
+					 * output ranges from -4.0 to 4.0. That should
+					 * be allright.
+					 */
+					mixer_gain[address & 0x0f] = (float)byte / (32768 * 255);
+					break;
+				case 0xa0:
+					switch (address & 0x0f) {
+						case 0x00:
+						case 0x01:
+						case 0x02:
+						case 0x03:
+							/*
+							 * 0 = fast, 1 = interpolate,
+							 * 2 = resample interpolate,
+							 * 3 = resample fast
+							 */
+							if (byte <= SAMPLE_RESAMPLE_FAST) {
+								int i = address & 0x03;
+								wake_sid(i);
+								if (sid[i].set_sampling_parameters(SID_CLOCK_SPEED, (sampling_method)byte, SAMPLE_RATE)) {
+									sid_quality[i] = byte;
+								} else {
+									sid[i].set_sampling_parameters(SID_CLOCK_SPEED, (sampling_method)sid_quality[i], SAMPLE_RATE);
+								}
+							}
+							break;
+						default:
+							break;
+					}
+					break;
+				case 0xc0:
+				case 0xd0:
+				case 0xe0:
+				case 0xf0:
+					delay[(address & 0x38) >> 3].write_byte(address & 0x07, byte);
 					break;
 				default:
 					break;
@@ -281,12 +402,56 @@ void sound_ic::io_write_byte(uint16_t address, uint8_t byte)
 	}
 }
 
-void sound_ic::run(uint32_t number_of_cycles)
+void sound_ic::wake_sid(int i)
+{
+	if (sid_skipped_cycles[i]) {
+		/*
+		 * Catch up including (discarded) samples, this keeps the
+		 * sid's sample clock in sync with the master clock
+		 */
+		int16_t scratch[SID_BUFFER_SIZE];
+		cycle_count cycles = sid_skipped_cycles[i] > SID_CATCH_UP_MAX ?
+			SID_CATCH_UP_MAX : sid_skipped_cycles[i];
+		while (cycles > 0) {
+			sid[i].clock(cycles, scratch, SID_BUFFER_SIZE);
+		}
+		sid_skipped_cycles[i] = 0;
+	}
+	sid_silent[i] = false;
+	sid_quiet_cycles[i] = 0;
+}
+
+static bool sid_is_silent_state(SID::State &state)
+{
+	if ((state.sid_register[0x18] & 0x0f) == 0) return true;	// volume
+
+	for (int v=0; v<3; v++) {
+		if (state.sid_register[(7 * v) + 4] & 0b1) return false;	// gate
+		if (state.envelope_counter[v]) return false;
+	}
+	return true;
+}
+
+bool sound_ic::sid_is_silent(int i)
+{
+	if (sid[i].output() || delay[i].active) return false;
+
+	SID::State state = sid[i].read_state();
+	return sid_is_silent_state(state);
+}
+
+void sound_ic::clock_sid(int i)
 {
-	delta_t_sid0 += number_of_cycles;
-	delta_t_sid1 = delta_t_sid0;
-	delta_t_sid2 = delta_t_sid0;
-	delta_t_sid3 = delta_t_sid0;
+	int16_t *buffer = sid_buffer[i];
+
+	if (sid_silent[i]) {
+		sid_skipped_cycles[i] += pass_cycles;
+		for (int j=0; j<pass_samples; j++) {
+			f_sid_buffer[i][j] = 0.0;
+		}
+		return;
+	}
+
 	/*
 	 * clock(delta_t, buf, maxNoOfSamples) function:
 	 *
@@ -294,80 +459,244 @@ void sound_ic::run(uint32_t number_of_cycles)
 	 * delta_t is a REFERENCE to the number of cycles to be processed
 	 * buf is the memory area in which data should be written
 	 * maxNoOfSamples (internal size of the presented buffer)
+	 *
+	 * A sid in SAMPLE_FAST mode delivers exactly pass_samples.
+	 */
+	cycle_count cycles = pass_cycles;
+	int available = sid_pending[i] +
+		sid[i].clock(cycles, &buffer[sid_pending[i]], SID_BUFFER_SIZE + SID_BUFFER_SLACK - sid_pending[i]);
+
+	if (available < pass_samples) {
+		// one short, repeat last sample
+		int16_t last = available ? buffer[available - 1] : 0;
+		for (int j=available; j<pass_samples; j++) buffer[j] = last;
+		sid_pending[i] = 0;
+	} else {
+		sid_pending[i] = available - pass_samples;
+		if (sid_pending[i] > SID_BUFFER_SLACK) sid_pending[i] = SID_BUFFER_SLACK;
+	}
+
+	/*
+	 * int16_t to float, through delay when active
 	 */
-	int n = sid[0].clock(delta_t_sid0, sample_buffer_mono_sid0, 65536);
-	sid[1].clock(delta_t_sid1, sample_buffer_mono_sid1, 65536);
-	sid[2].clock(delta_t_sid2, sample_buffer_mono_sid2, 65536);
-	sid[3].clock(delta_t_sid3, sample_buffer_mono_sid3, 65536);
+	delay[i].process(buffer, f_sid_buffer[i], pass_samples);
 
 	/*
-	 * Analog is not connected to the cycles made by the machine,
-	 * it only needs to know the amount of samples to produce.
+	 * A sid only counts as quiet when all of its samples were zero
 	 */
-	analog0.run(n, sample_buffer_mono_analog0);
-	analog1.run(n, sample_buffer_mono_analog1);
-	analog2.run(n, sample_buffer_mono_analog2);
-	analog3.run(n, sample_buffer_mono_analog3);
+	int16_t quiet = 0;
+	for (int j=0; j<pass_samples; j++) quiet |= buffer[j];
+
+	if (sid_pending[i]) {
+		for (int j=0; j<sid_pending[i]; j++) {
+			buffer[j] = buffer[pass_samples + j];
+		}
+	}
+
+	if ((quiet == 0) && sid_is_silent(i)) {
+		sid_quiet_cycles[i] += pass_cycles;
+		sid_silent[i] = (sid_quiet_cycles[i] >= SID_SILENCE_CYCLES);
+	} else {
+		sid_quiet_cycles[i] = 0;
+	}
+}
 
+inline void sound_ic::mix(const float *source, int gain, int n)
+{
+	/*
+	 * Gain matrix, normalized left and right balance
+	 */
+	const float gain_left = mixer_gain[(2 * gain) + 0];
+	const float gain_right = mixer_gain[(2 * gain) + 1];
 	for (int i=0; i<n; i++) {
-		f_sample_buffer_mono_sid0[i] = delay[0].sample(sample_buffer_mono_sid0[i]);
-		f_sample_buffer_mono_sid1[i] = delay[1].sample(sample_buffer_mono_sid1[i]);
-		f_sample_buffer_mono_sid2[i] = delay[2].sample(sample_buffer_mono_sid2[i]);
-		f_sample_buffer_mono_sid3[i] = delay[3].sample(sample_buffer_mono_sid3[i]);
-
-		f_sample_buffer_mono_analog0[i] = delay[4].sample(sample_buffer_mono_analog0[i]);
-		f_sample_buffer_mono_analog1[i] = delay[5].sample(sample_buffer_mono_analog1[i]);
-		f_sample_buffer_mono_analog2[i] = delay[6].sample(sample_buffer_mono_analog2[i]);
-		f_sample_buffer_mono_analog3[i] = delay[7].sample(sample_buffer_mono_analog3[i]);
-
-		// left channel
-		sample_buffer_stereo[(2 * i) + 0] =
-			(f_sample_buffer_mono_sid0[i]    * balance_registers[0x0]) +
-			(f_sample_buffer_mono_sid1[i]    * balance_registers[0x2]) +
-			(f_sample_buffer_mono_sid2[i]    * balance_registers[0x4]) +
-			(f_sample_buffer_mono_sid3[i]    * balance_registers[0x6]) +
-			(f_sample_buffer_mono_analog0[i] * balance_registers[0x8]) +
-			(f_sample_buffer_mono_analog1[i] * balance_registers[0xa]) +
-			(f_sample_buffer_mono_analog2[i] * balance_registers[0xc]) +
-			(f_sample_buffer_mono_analog3[i] * balance_registers[0xe]);
-
-		// right channel
-		sample_buffer_stereo[(2 * i) + 1] =
-			(f_sample_buffer_mono_sid0[i]    * balance_registers[0x1]) +
-			(f_sample_buffer_mono_sid1[i]    * balance_registers[0x3]) +
-			(f_sample_buffer_mono_sid2[i]    * balance_registers[0x5]) +
-			(f_sample_buffer_mono_sid3[i]    * balance_registers[0x7]) +
-			(f_sample_buffer_mono_analog0[i] * balance_registers[0x9]) +
-			(f_sample_buffer_mono_analog1[i] * balance_registers[0xb]) +
-			(f_sample_buffer_mono_analog2[i] * balance_registers[0xd]) +
-			(f_sample_buffer_mono_analog3[i] * balance_registers[0xf]);
+		mix_left[i] += source[i] * gain_left;
+		mix_right[i] += source[i] * gain_right;
+	}
+}
+
+void sound_ic::run(uint32_t number_of_cycles)
+{
+	delta_t += number_of_cycles;
 
+	do {
 		/*
-		 * Normalize both channels
-		 *
-		 * Output of both sids and analogs is int16_t (-32768,32767).
-		 * Balance registers are 0-255. So if divided by 32768 * 255,
-		 * maximum (float) output ranges from -4.0 to 4.0. That should
-		 * be allright.
+		 * Master sample clock, at most SID_BUFFER_SIZE samples
 		 */
-		sample_buffer_stereo[(2 * i) + 0] /= 32768 * 255;	// left
-		sample_buffer_stereo[(2 * i) + 1] /= 32768 * 255;	// right
+		pass_cycles = 0;
+		pass_samples = 0;
+		for (;;) {
+			cycle_count next_sample_offset = sample_offset + cycles_per_sample + (1 << 15);
+			cycle_count delta_t_sample = next_sample_offset >> 16;
+			if (delta_t_sample > delta_t) {
+				sample_offset -= delta_t << 16;
+				pass_cycles += delta_t;
+				delta_t = 0;
+				break;
+			}
+			if (pass_samples >= SID_BUFFER_SIZE) break;
+			pass_cycles += delta_t_sample;
+			delta_t -= delta_t_sample;
+			sample_offset = (next_sample_offset & 0xffff) - (1 << 15);
+			pass_samples++;
+		}
+
+		if (parallel && (pass_cycles >= SID_PARALLEL_MIN_CYCLES)) {
+			{
+				std::lock_guard<std::mutex> lock(sid_worker_mutex);
+				sid_workers_busy = 3;
+				sid_worker_generation++;
+			}
+			sid_worker_start.notify_all();
+
+			clock_sid(0);
 
-		if (sound_starting) {
-			sample_buffer_stereo[2 * i] *= (float)(4000-sound_starting) / 4000;
-			sample_buffer_stereo[(2 * i) + 1] *= (float)(4000-sound_starting) / 4000;
-			sound_starting--;
+			std::unique_lock<std::mutex> lock(sid_worker_mutex);
+			sid_worker_done.wait(lock, [&] { return sid_workers_busy == 0; });
+		} else {
+			for (int i=0; i<4; i++) {
+				clock_sid(i);
+			}
 		}
 
-		//settings->audio_record_push_sample(sample_buffer_stereo[ 2 * i     ]);
-		//settings->audio_record_push_sample(sample_buffer_stereo[(2 * i) + 1]);
+		int n = pass_samples;
+
+		/*
+		 * Mix in blocks of at most MIXER_BLOCK_SIZE samples
+		 */
+		for (int start=0; start<n; start += MIXER_BLOCK_SIZE) {
+			int m = ((n - start) < MIXER_BLOCK_SIZE) ? (n - start) : MIXER_BLOCK_SIZE;
+
+			for (int i=0; i<m; i++) {
+				mix_left[i] = 0.0;
+				mix_right[i] = 0.0;
+			}
+
+			for (int i=0; i<4; i++) {
+				mix(&f_sid_buffer[i][start], i, m);
+			}
+
+			/*
+			 * Analog is not connected to the cycles made by the
+			 * machine, it only needs to know the amount of
+			 * samples to produce. One scratch buffer is shared by
+			 * all four.
+			 */
+			analog_ic *analogs[4] = { &analog0, &analog1, &analog2, &analog3 };
+			for (int i=0; i<4; i++) {
+				analogs[i]->run(m, sample_buffer_mono);
+				delay[4 + i].process(sample_buffer_mono, f_sample_buffer_mono, m);
+				mix(f_sample_buffer_mono, 4 + i, m);
+			}
+
+			/*
+			 * Fade in after reset
+			 */
+			if (sound_starting) {
+				int k = (m < sound_starting) ? m : sound_starting;
+				for (int i=0; i<k; i++) {
+					float fade = (float)(4000 - (sound_starting - i)) / 4000;
+					mix_left[i] *= fade;
+					mix_right[i] *= fade;
+				}
+				sound_starting -= k;
+			}
+
+			/*
+			 * Interleave into stereo buffer
+			 */
+			for (int i=0; i<m; i++) {
+				sample_buffer_stereo[(2 * i) + 0] = mix_left[i];
+				sample_buffer_stereo[(2 * i) + 1] = mix_right[i];
+			}
+
+			system->host->queue_audio((void *)sample_buffer_stereo, 2 * m * system->host->get_bytes_per_sample());
+		}
+	} while (delta_t > 0);
+}
+
+void sound_ic::save_state(state_t *s)
+{
+	s->put(delta_t);
+	s->put(sample_offset);
+	s->put(sound_starting);
+
+	/*
+	 * Silent sids are saved as they are, including the cycles they
+	 * still have to catch up
+	 */
+	for (int i=0; i<4; i++) {
+		s->put(sid_quality[i]);
+		s->put(sid_silent[i]);
+		s->put(sid_quiet_cycles[i]);
+		s->put(sid_skipped_cycles[i]);
+		SID::State state = sid[i].read_state();
+		s->put(state);
+		s->put(sid_pending[i]);
+		s->put_bytes(sid_buffer[i], sid_pending[i] * sizeof(int16_t));
+	}
+	s->put_bytes(sid_shadow, sizeof(sid_shadow));
+
+	analog0.save_state(s);
+	analog1.save_state(s);
+	analog2.save_state(s);
+	analog3.save_state(s);
+
+	for (int i=0; i<8; i++) {
+		delay[i].save_state(s);
 	}
 
-	system->host->queue_audio((void *)sample_buffer_stereo, 2 * n * system->host->get_bytes_per_sample());
+	s->put_bytes(balance_registers, sizeof(balance_registers));
+}
+
+void sound_ic::load_state(state_t *s)
+{
+	s->get(delta_t);
+	s->get(sample_offset);
+	s->get(sound_starting);
+
+	for (int i=0; i<4; i++) {
+		uint8_t quality;
+		s->get(quality);
+		if (quality > SAMPLE_RESAMPLE_FAST) quality = SAMPLE_FAST;
+		if (sid[i].set_sampling_parameters(SID_CLOCK_SPEED, (sampling_method)quality, SAMPLE_RATE)) {
+			sid_quality[i] = quality;
+		}
+		s->get(sid_silent[i]);
+		s->get(sid_quiet_cycles[i]);
+		s->get(sid_skipped_cycles[i]);
+		SID::State state;
+		s->get(state);
+		sid[i].write_state(state);
+		s->get(sid_pending[i]);
+		if ((sid_pending[i] < 0) || (sid_pending[i] > SID_BUFFER_SLACK)) sid_pending[i] = 0;
+		s->get_bytes(sid_buffer[i], sid_pending[i] * sizeof(int16_t));
+	}
+	s->get_bytes(sid_shadow, sizeof(sid_shadow));
+
+	analog0.load_state(s);
+	analog1.load_state(s);
+	analog2.load_state(s);
+	analog3.load_state(s);
+
+	for (int i=0; i<8; i++) {
+		delay[i].load_state(s);
+	}
+
+	s->get_bytes(balance_registers, sizeof(balance_registers));
+	for (int i=0; i<0x10; i++) {
+		mixer_gain[i] = (float)balance_registers[i] / (32768 * 255);
+	}
 }
 
 void sound_ic::reset()
 {
+	for (int i=0; i<4; i++) {
+		sid_skipped_cycles[i] = 0;
+		sid_quiet_cycles[i] = 0;
+		sid_silent[i] = false;
+		sid_pending[i] = 0;
+	}
+
 	sid[0].reset();
 	sid[1].reset();
 	sid[2].reset();
@@ -7,12 +7,16 @@
 
 #include <cstdio>
 #include <cstdint>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #ifndef SOUND_HPP
 #define SOUND_HPP
 
 #include "sid.h" // resid header
 #include "analog.hpp"
+#include "state.hpp"
 #include "system.hpp"
 
 #include "common.hpp"
@@ -21,38 +25,192 @@
  * TODO: Write description of how dealing with shadow registers: they're always written to!
  */
 
+/*
+ * Number of samples mixed as one block
+ */
+#define MIXER_BLOCK_SIZE	256
+
+/*
+ * Maximum number of samples produced by a sid per pass (more than one
+ * frame), and minimum number of cycles to make a parallel pass worth it
+ */
+#define SID_BUFFER_SIZE		1024
+#define SID_BUFFER_SLACK	8
+#define SID_PARALLEL_MIN_CYCLES	(SID_CYCLES_PER_FRAME / 4)
+
+/*
+ * A sid must be quiet for this many cycles before it's skipped, the
+ * catch up after a long silence is limited (phase of the oscillators
+ * doesn't matter then)
+ */
+#define SID_SILENCE_CYCLES	SID_CYCLES_PER_FRAME
+#define SID_CATCH_UP_MAX	(SID_CLOCK_SPEED / 4)
+
+/*
+ * Max delay time, the buffer grows up to this size when needed
+ */
+#define DELAY_MAX_MS		1000
+
 class digital_delay_t {
-	/*
-	 * What's the max? E.g. 1s (1000ms)
-	 * @48000 sample rate, buffer max of 48000
-	 */
 	uint16_t delay_ms{200};
-	uint16_t current_buffer_size;
-	
+	uint32_t current_buffer_size;
+
 	float decay{0.6};
 	float dry{1.0};
 	float wet{0.8};
-	
-	float delay_buffer[65536] = { 0 };
-	uint16_t buffer_pointer{0};
-	
+
+	/*
+	 * Registers as seen by the cpu (decay, wet and dry in 1/255)
+	 */
+	uint8_t decay_register{153};
+	uint8_t dry_register{255};
+	uint8_t wet_register{204};
+
+	/*
+	 * Only allocated once the delay is used for the first time, and
+	 * reallocated when a longer delay doesn't fit
+	 */
+	float *delay_buffer{nullptr};
+	uint32_t allocated_size{0};
+	uint32_t buffer_pointer{0};
+
 public:
 	digital_delay_t() {
 		current_buffer_size = (SAMPLE_RATE / 1000) * delay_ms;
 	}
-	
+
+	~digital_delay_t() {
+		if (delay_buffer) delete [] delay_buffer;
+	}
+
 	bool active{false};
-	
-	inline float sample(float input) {
+
+	/*
+	 * Register interface, 8 bytes per delay:
+	 * 0-1 delay in ms (big endian, 1-1000), 2 decay, 3 wet, 4 dry
+	 */
+	uint8_t read_byte(uint8_t address) {
+		switch (address & 0x07) {
+			case 0x00: return (delay_ms & 0xff00) >> 8;
+			case 0x01: return delay_ms & 0x00ff;
+			case 0x02: return decay_register;
+			case 0x03: return wet_register;
+			case 0x04: return dry_register;
+			default:   return 0x00;
+		}
+	}
+
+	void write_byte(uint8_t address, uint8_t byte) {
+		switch (address & 0x07) {
+			case 0x00:
+				set_delay_ms((delay_ms & 0x00ff) | (byte << 8));
+				break;
+			case 0x01:
+				set_delay_ms((delay_ms & 0xff00) | byte);
+				break;
+			case 0x02:
+				decay_register = byte;
+				decay = (float)byte / 255;
+				break;
+			case 0x03:
+				wet_register = byte;
+				wet = (float)byte / 255;
+				break;
+			case 0x04:
+				dry_register = byte;
+				dry = (float)byte / 255;
+				break;
+			default:
+				break;
+		}
+	}
+
+	void set_delay_ms(uint16_t ms) {
+		if (ms < 1) ms = 1;
+		if (ms > DELAY_MAX_MS) ms = DELAY_MAX_MS;
+		delay_ms = ms;
+		current_buffer_size = (SAMPLE_RATE / 1000) * delay_ms;
+		if (buffer_pointer >= current_buffer_size) buffer_pointer = 0;
+	}
+
+	void save_state(state_t *s) {
+		s->put(active);
+		s->put(delay_ms);
+		s->put(decay_register);
+		s->put(wet_register);
+		s->put(dry_register);
+		s->put(buffer_pointer);
+		s->put(allocated_size);
+		if (allocated_size) s->put_bytes(delay_buffer, allocated_size * sizeof(float));
+	}
+
+	void load_state(state_t *s) {
+		uint16_t ms;
+		uint8_t registers[3];
+		uint32_t pointer, size;
+		s->get(active);
+		s->get(ms);
+		s->get_bytes(registers, 3);
+		s->get(pointer);
+		s->get(size);
+		set_delay_ms(ms);
+		write_byte(0x02, registers[0]);
+		write_byte(0x03, registers[1]);
+		write_byte(0x04, registers[2]);
+		if (size > (SAMPLE_RATE / 1000) * DELAY_MAX_MS) size = 0;
+		if (size > allocated_size) {
+			if (delay_buffer) delete [] delay_buffer;
+			delay_buffer = new float[size];
+			allocated_size = size;
+		}
+		if (size) s->get_bytes(delay_buffer, size * sizeof(float));
+		for (uint32_t i=size; i<allocated_size; i++) delay_buffer[i] = 0.0;
+		buffer_pointer = (pointer < current_buffer_size) ? pointer : 0;
+	}
+
+	/*
+	 * Converts a buffer of samples to float. Without an active delay
+	 * this is a plain conversion. With a delay, the block is cut in
+	 * contiguous segments up to the wrap around of the delay buffer,
+	 * the loop over a segment has no dependencies and vectorises.
+	 */
+	inline void process(const int16_t *input, float *output, int n) {
 		if (!active) {
-			return input;
-		} else {
-			float output = decay * delay_buffer[buffer_pointer];
-			delay_buffer[buffer_pointer] = input + output;
-			buffer_pointer++;
-			if (buffer_pointer >= current_buffer_size)
-				buffer_pointer = 0;
-			return (dry * input) + (wet * output);
+			for (int i=0; i<n; i++) output[i] = input[i];
+			return;
+		}
+
+		if (allocated_size < current_buffer_size) {
+			float *new_buffer = new float[current_buffer_size];
+			for (uint32_t i=0; i<current_buffer_size; i++) {
+				new_buffer[i] = (i < allocated_size) ? delay_buffer[i] : 0.0;
+			}
+			if (delay_buffer) delete [] delay_buffer;
+			delay_buffer = new_buffer;
+			allocated_size = current_buffer_size;
+		}
+
+		const float d = decay;
+		const float w = wet;
+		const float y = dry;
+
+		while (n > 0) {
+			int segment = current_buffer_size - buffer_pointer;
+			if (segment > n) segment = n;
+
+			float *buffer = &delay_buffer[buffer_pointer];
+			for (int i=0; i<segment; i++) {
+				float in = input[i];
+				float out = d * buffer[i];
+				buffer[i] = in + out;
+				output[i] = (y * in) + (w * out);
+			}
+
+			input += segment;
+			output += segment;
+			n -= segment;
+			buffer_pointer += segment;
+			if (buffer_pointer >= current_buffer_size) buffer_pointer = 0;
 		}
 	}
 };
@@ -62,21 +220,59 @@ private:
 	/*
 	 * sid variables etc...
 	 */
-	cycle_count delta_t_sid0;
-	int16_t sample_buffer_mono_sid0[65536] = { 0 };	// this buffer connects to sid library, must be int16_t
-	float f_sample_buffer_mono_sid0[65536] = { 0.0 }; // this buffer is used for processing (no clipping with floats)
-	
-	cycle_count delta_t_sid1;
-	int16_t sample_buffer_mono_sid1[65536] = { 0 };
-	float f_sample_buffer_mono_sid1[65536] = { 0.0 }; // this buffer is used for processing (no clipping with floats)
-	
-	cycle_count delta_t_sid2;
-	int16_t sample_buffer_mono_sid2[65536] = { 0 };
-	float f_sample_buffer_mono_sid2[65536] = { 0.0 }; // this buffer is used for processing (no clipping with floats)
-	
-	cycle_count delta_t_sid3;
-	int16_t sample_buffer_mono_sid3[65536] = { 0 };
-	float f_sample_buffer_mono_sid3[65536] = { 0.0 }; // this buffer is used for processing (no clipping with floats)
+	/*
+	 * Master sample clock, same algorithm as reSID's SAMPLE_FAST. It
+	 * decides how many cycles and samples make up a pass, every sid
+	 * gets exactly these cycles.
+	 */
+	cycle_count delta_t;
+	cycle_count sample_offset;
+	cycle_count cycles_per_sample;
+	cycle_count pass_cycles;
+	int pass_samples;
+
+	/*
+	 * Sids in another sampling mode may deliver a sample more or less
+	 * than the master clock in a pass. Extra samples are carried over
+	 * (max SID_BUFFER_SLACK) to the next pass.
+	 */
+	int16_t sid_buffer[4][SID_BUFFER_SIZE + SID_BUFFER_SLACK];	// connects to sid library, must be int16_t
+	float f_sid_buffer[4][SID_BUFFER_SIZE];		// after delay, used for processing
+	int sid_pending[4];
+
+	/*
+	 * Sampling quality per sid (register), see enum sampling_method
+	 */
+	uint8_t sid_quality[4];
+
+	/*
+	 * A silent sid (zero output and either zero volume or all voices
+	 * released to zero) isn't clocked. Skipped cycles are caught up
+	 * when the cpu accesses the chip.
+	 */
+	bool sid_silent[4];
+	cycle_count sid_quiet_cycles[4];
+	cycle_count sid_skipped_cycles[4];
+	void wake_sid(int i);
+	bool sid_is_silent(int i);
+
+	void clock_sid(int i);
+
+	/*
+	 * Optional worker threads for sid 1, 2 and 3 (sid 0 is done by
+	 * the calling thread). Each worker only touches its own sid,
+	 * delay and buffers, all threads join before mixing.
+	 */
+	std::thread sid_workers[3];
+	std::mutex sid_worker_mutex;
+	std::condition_variable sid_worker_start;
+	std::condition_variable sid_worker_done;
+	uint32_t sid_worker_generation{0};
+	int sid_workers_busy{0};
+	bool sid_workers_quit{false};
+	bool parallel{false};
+
+	void sid_worker(int i);
 	
 	uint8_t sid_shadow[128];
 	
@@ -93,20 +289,24 @@ private:
 	analog_ic analog1;
 	analog_ic analog2;
 	analog_ic analog3;
-	int16_t sample_buffer_mono_analog0[65536] = { 0 };
-	float f_sample_buffer_mono_analog0[65536] = { 0.0 };
-	int16_t sample_buffer_mono_analog1[65536];
-	float f_sample_buffer_mono_analog1[65536] = { 0.0 };
-	int16_t sample_buffer_mono_analog2[65536];
-	float f_sample_buffer_mono_analog2[65536] = { 0.0 };
-	int16_t sample_buffer_mono_analog3[65536];
-	float f_sample_buffer_mono_analog3[65536] = { 0.0 };
-	
+
 	/*
 	 * General
 	 */
 	uint8_t balance_registers[0x10];
-	float sample_buffer_stereo[131072];
+	float mixer_gain[0x10];		// normalized balance registers
+
+	/*
+	 * Scratch buffers for one block, shared by all sources. A source
+	 * is produced and added to the mix before the next one is done.
+	 */
+	int16_t sample_buffer_mono[MIXER_BLOCK_SIZE];
+	float f_sample_buffer_mono[MIXER_BLOCK_SIZE];	// used for processing (no clipping with floats)
+	float mix_left[MIXER_BLOCK_SIZE];
+	float mix_right[MIXER_BLOCK_SIZE];
+	float sample_buffer_stereo[2 * MIXER_BLOCK_SIZE];
+
+	inline void mix(const float *source, int gain, int n);
 	
 	uint16_t sound_starting;
 	
@@ -125,6 +325,20 @@ public:
 	// and process all the accumulated cycles (flush into soundbuffer)
 	void run(uint32_t number_of_cycles);
 	void reset();
+
+	/*
+	 * In between runs only (no pending cycles). reSID's state (with
+	 * the filter integrators added) covers everything but the sample
+	 * history of the resampling modes, which refills after a load.
+	 */
+	void save_state(state_t *s);
+	void load_state(state_t *s);
+
+	/*
+	 * Clock the four sids on worker threads
+	 */
+	void set_parallel(bool p);
+	inline bool is_parallel() { return parallel; }
 };
 
 #endif
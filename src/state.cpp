@@ -0,0 +1,409 @@
+/*
+ * state.cpp
+ * punch
+ *
+ * Copyright © 2025 elmerucr. All rights reserved.
+ */
+
+#include "state.hpp"
+#include "core.hpp"
+#include "keyboard.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+state_t::~state_t()
+{
+	if (data) delete [] data;
+}
+
+void state_t::clear()
+{
+	size = 0;
+	position = 0;
+	error = false;
+}
+
+uint8_t *state_t::reserve(size_t n)
+{
+	if (size + n > capacity) {
+		size_t new_capacity = capacity ? capacity : 4096;
+		while (new_capacity < size + n) new_capacity *= 2;
+		uint8_t *new_data = new uint8_t[new_capacity];
+		if (data) {
+			memcpy(new_data, data, size);
+			delete [] data;
+		}
+		data = new_data;
+		capacity = new_capacity;
+	}
+	return &data[size];
+}
+
+void state_t::put_bytes(const void *p, size_t n)
+{
+	memcpy(reserve(n), p, n);
+	size += n;
+}
+
+const uint8_t *state_t::take(size_t n)
+{
+	if (error || (n > size - position)) {
+		error = true;
+		return nullptr;
+	}
+	const uint8_t *result = &data[position];
+	position += n;
+	return result;
+}
+
+void state_t::get_bytes(void *p, size_t n)
+{
+	const uint8_t *source = take(n);
+	if (source) {
+		memcpy(p, source, n);
+	} else {
+		memset(p, 0, n);
+	}
+}
+
+bool state_t::save(const char *path)
+{
+	FILE *f = fopen(path, "wb");
+	if (!f) return false;
+	bool result = (fwrite(data, 1, size, f) == size);
+	fclose(f);
+	return result;
+}
+
+bool state_t::load(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f) return false;
+	clear();
+	uint8_t block[65536];
+	size_t n;
+	while ((n = fread(block, 1, sizeof(block), f)) > 0) {
+		put_bytes(block, n);
+	}
+	fclose(f);
+	return true;
+}
+
+snapshot_t::snapshot_t(system_t *s)
+{
+	system = s;
+
+	/*
+	 * Ids only need to be unique within a session and unlikely to
+	 * collide with one of an earlier session
+	 */
+	next_id = (uint64_t)std::chrono::system_clock::now().time_since_epoch().count() | 1;
+}
+
+snapshot_t::~snapshot_t()
+{
+	if (reference) blitter_ic::free_vram(reference);
+}
+
+/*
+ * Run length encoding of one page, packbits style. A control byte c
+ * of 0-127 is followed by c+1 literal bytes, 129-255 is followed by
+ * one byte that repeats 257-c times.
+ */
+void snapshot_t::put_page(state_t *state, const uint8_t *page, const uint8_t *ref)
+{
+	uint8_t source[VRAM_PAGE_SIZE];
+	if (ref) {
+		for (int i=0; i<VRAM_PAGE_SIZE; i++) source[i] = page[i] ^ ref[i];
+		page = source;
+	}
+
+	uint8_t *start = state->reserve(2 + VRAM_PAGE_SIZE + (VRAM_PAGE_SIZE / 128) + 1);
+	uint8_t *out = start + 2;
+
+	int i = 0;
+	while (i < VRAM_PAGE_SIZE) {
+		int run = 1;
+		while ((i + run < VRAM_PAGE_SIZE) && (run < 128) && (page[i + run] == page[i])) run++;
+
+		if (run >= 3) {
+			*out++ = 257 - run;
+			*out++ = page[i];
+			i += run;
+		} else {
+			/*
+			 * Literals, up to the start of the next run
+			 */
+			int literal = 0;
+			while ((i + literal < VRAM_PAGE_SIZE) && (literal < 128)) {
+				if ((i + literal + 2 < VRAM_PAGE_SIZE) &&
+				    (page[i + literal] == page[i + literal + 1]) &&
+				    (page[i + literal] == page[i + literal + 2])) break;
+				literal++;
+			}
+			*out++ = literal - 1;
+			memcpy(out, &page[i], literal);
+			out += literal;
+			i += literal;
+		}
+	}
+
+	/*
+	 * Encoded length first (16 bit, host order)
+	 */
+	uint16_t length = out - (start + 2);
+	memcpy(start, &length, 2);
+	state->commit(2 + length);
+}
+
+bool snapshot_t::get_page(state_t *state, uint8_t *page)
+{
+	uint16_t length;
+	state->get(length);
+	const uint8_t *in = state->take(length);
+	if (!in) return false;
+	const uint8_t *end = in + length;
+
+	int i = 0;
+	while (in < end) {
+		uint8_t c = *in++;
+		if (c < 128) {
+			int literal = c + 1;
+			if ((end - in < literal) || (i + literal > VRAM_PAGE_SIZE)) return false;
+			memcpy(&page[i], in, literal);
+			in += literal;
+			i += literal;
+		} else if (c > 128) {
+			int run = 257 - c;
+			if ((in == end) || (i + run > VRAM_PAGE_SIZE)) return false;
+			memset(&page[i], *in++, run);
+			i += run;
+		} else {
+			return false;
+		}
+	}
+	return i == VRAM_PAGE_SIZE;
+}
+
+bool snapshot_t::check_pages(state_t *state)
+{
+	uint8_t page[VRAM_PAGE_SIZE];
+	uint32_t index;
+
+	for (;;) {
+		state->get(index);
+		if (state->failed()) return false;
+		if (index == 0xffffffff) return true;
+		if ((index >= VRAM_PAGES) || !get_page(state, page)) return false;
+	}
+}
+
+void snapshot_t::take(state_t *state, enum state_kind kind)
+{
+	std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+
+	blitter_ic *blitter = system->core->blitter;
+	const uint8_t *vram = blitter->vram;
+
+	if (!reference) {
+		reference = blitter_ic::allocate_vram();
+		reference_id = 0;
+	}
+	if (reference_id == 0) kind = STATE_FULL;
+
+	uint64_t id = next_id++;
+
+	state->clear();
+	state->put((uint32_t)STATE_MAGIC);
+	state->put((uint32_t)STATE_VERSION);
+	state->put((uint8_t)kind);
+	state->put(id);
+	state->put(reference_id);
+
+	machine.clear();
+	system->core->save_state(&machine);
+	system->keyboard->save_state(&machine);
+	state->put((uint32_t)machine.get_size());
+	state->put_bytes(machine.take(machine.get_size()), machine.get_size());
+
+	uint32_t since = checkpoint;
+	checkpoint = blitter->dirty_checkpoint();
+
+	for (uint32_t p=0; p<VRAM_PAGES; p++) {
+		const uint8_t *page = &vram[p * VRAM_PAGE_SIZE];
+		uint8_t *ref = &reference[p * VRAM_PAGE_SIZE];
+
+		if (kind == STATE_FULL) {
+			state->put(p);
+			put_page(state, page, nullptr);
+			if (memcmp(ref, page, VRAM_PAGE_SIZE)) memcpy(ref, page, VRAM_PAGE_SIZE);
+		} else if (blitter->is_page_dirty(p, since) && memcmp(page, ref, VRAM_PAGE_SIZE)) {
+			state->put(p);
+			put_page(state, page, ref);
+			memcpy(ref, page, VRAM_PAGE_SIZE);
+		}
+	}
+	state->put((uint32_t)0xffffffff);
+
+	reference_id = id;
+
+	duration_ms = (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000;
+}
+
+bool snapshot_t::read_header(state_t *state, struct header_t *header)
+{
+	uint32_t magic, version;
+
+	state->rewind();
+	state->get(magic);
+	state->get(version);
+	state->get(header->kind);
+	state->get(header->id);
+	state->get(header->base_id);
+	state->get(header->machine_size);
+	header->machine_data = state->take(header->machine_size);
+
+	if (state->failed() || (magic != STATE_MAGIC) || (version != STATE_VERSION)) return false;
+	if ((header->kind != STATE_FULL) && (header->kind != STATE_INCREMENTAL)) return false;
+
+	header->pages_position = state->get_position();
+	return check_pages(state);
+}
+
+/*
+ * Vram back to the contents of the last snapshot
+ */
+void snapshot_t::revert_vram()
+{
+	blitter_ic *blitter = system->core->blitter;
+
+	for (uint32_t p=0; p<VRAM_PAGES; p++) {
+		if (!blitter->is_page_dirty(p, checkpoint)) continue;
+		uint8_t *page = &blitter->vram[p * VRAM_PAGE_SIZE];
+		const uint8_t *ref = &reference[p * VRAM_PAGE_SIZE];
+		if (memcmp(page, ref, VRAM_PAGE_SIZE)) {
+			memcpy(page, ref, VRAM_PAGE_SIZE);
+			blitter->mark_dirty(p * VRAM_PAGE_SIZE);
+		}
+	}
+}
+
+/*
+ * Xors the (already checked) delta pages of an incremental state into
+ * reference and vram
+ */
+void snapshot_t::apply_delta(state_t *state, struct header_t *header)
+{
+	uint8_t *vram = system->core->blitter->vram;
+	uint8_t delta[VRAM_PAGE_SIZE];
+	uint32_t index;
+
+	state->set_position(header->pages_position);
+	for (state->get(index); index != 0xffffffff; state->get(index)) {
+		uint8_t *page = &vram[index * VRAM_PAGE_SIZE];
+		uint8_t *ref = &reference[index * VRAM_PAGE_SIZE];
+		get_page(state, delta);
+		for (int i=0; i<VRAM_PAGE_SIZE; i++) ref[i] ^= delta[i];
+		memcpy(page, ref, VRAM_PAGE_SIZE);
+		system->core->blitter->mark_dirty(index * VRAM_PAGE_SIZE);
+	}
+}
+
+void snapshot_t::load_machine(struct header_t *header)
+{
+	machine.clear();
+	machine.put_bytes(header->machine_data, header->machine_size);
+	system->core->load_state(&machine);
+	system->keyboard->load_state(&machine);
+}
+
+bool snapshot_t::restore(state_t *state)
+{
+	std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+
+	struct header_t header;
+
+	if (!read_header(state, &header)) return false;
+	if ((header.kind == STATE_INCREMENTAL) && (!reference || (header.base_id != reference_id))) return false;
+
+	/*
+	 * From here on the state is known to be complete
+	 */
+	if (header.kind == STATE_FULL) {
+		if (!reference) reference = blitter_ic::allocate_vram();
+		uint8_t *vram = system->core->blitter->vram;
+		uint8_t decoded[VRAM_PAGE_SIZE];
+
+		/*
+		 * Pages are only written when they differ, untouched vram
+		 * (see blitter_ic) stays untouched
+		 */
+		state->set_position(header.pages_position);
+		uint32_t index;
+		for (state->get(index); index != 0xffffffff; state->get(index)) {
+			uint8_t *page = &vram[index * VRAM_PAGE_SIZE];
+			uint8_t *ref = &reference[index * VRAM_PAGE_SIZE];
+			get_page(state, decoded);
+			if (memcmp(page, decoded, VRAM_PAGE_SIZE)) memcpy(page, decoded, VRAM_PAGE_SIZE);
+			if (memcmp(ref, decoded, VRAM_PAGE_SIZE)) memcpy(ref, decoded, VRAM_PAGE_SIZE);
+			system->core->blitter->mark_dirty(index * VRAM_PAGE_SIZE);
+		}
+	} else {
+		revert_vram();
+		apply_delta(state, &header);
+	}
+
+	load_machine(&header);
+
+	reference_id = header.id;
+	checkpoint = system->core->blitter->dirty_checkpoint();
+
+	duration_ms = (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000;
+
+	return true;
+}
+
+bool snapshot_t::step_back(state_t *newest, state_t *previous)
+{
+	std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+
+	struct header_t newest_header, previous_header;
+
+	if (!read_header(newest, &newest_header)) return false;
+	if (!read_header(previous, &previous_header)) return false;
+	if ((newest_header.kind != STATE_INCREMENTAL) || !reference) return false;
+	if ((newest_header.id != reference_id) || (newest_header.base_id != previous_header.id)) return false;
+
+	revert_vram();
+	apply_delta(newest, &newest_header);
+
+	load_machine(&previous_header);
+
+	reference_id = previous_header.id;
+	checkpoint = system->core->blitter->dirty_checkpoint();
+
+	duration_ms = (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000;
+
+	return true;
+}
+
+bool snapshot_t::revert(state_t *newest)
+{
+	std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+
+	struct header_t header;
+
+	if (!read_header(newest, &header)) return false;
+	if (!reference || (header.id != reference_id)) return false;
+
+	revert_vram();
+
+	load_machine(&header);
+
+	checkpoint = system->core->blitter->dirty_checkpoint();
+
+	duration_ms = (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000;
+
+	return true;
+}
@@ -0,0 +1,168 @@
+/*
+ * state.hpp
+ * punch
+ *
+ * Copyright © 2025 elmerucr. All rights reserved.
+ */
+
+#ifndef STATE_HPP
+#define STATE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include "common.hpp"
+
+#define STATE_MAGIC		0x48434e50	// "PNCH" when written little endian
+#define STATE_VERSION		1
+
+/*
+ * Growable byte stream that components serialise themselves into, and
+ * read back from in the same order. Values are stored in host byte
+ * order, state files aren't meant to move between hosts of different
+ * endianness. Reading past the end yields zeroes and sets an error.
+ */
+class state_t {
+public:
+	state_t() {}
+	~state_t();
+
+	void clear();
+	inline void rewind() { position = 0; error = false; }
+
+	void put_bytes(const void *p, size_t n);
+	void get_bytes(void *p, size_t n);
+
+	template <typename T>
+	inline void put(const T &value) { put_bytes(&value, sizeof(T)); }
+
+	template <typename T>
+	inline void get(T &value) { get_bytes(&value, sizeof(T)); }
+
+	/*
+	 * Room for n more bytes at the end, followed by commit() of the
+	 * number of bytes actually written there
+	 */
+	uint8_t *reserve(size_t n);
+	inline void commit(size_t n) { size += n; }
+
+	/*
+	 * Next n bytes for reading (or nullptr)
+	 */
+	const uint8_t *take(size_t n);
+
+	inline size_t get_size() { return size; }
+	inline size_t get_capacity() { return capacity; }
+	inline size_t get_position() { return position; }
+	inline void set_position(size_t p) { position = p; }
+	inline bool failed() { return error; }
+
+	bool save(const char *path);
+	bool load(const char *path);
+
+private:
+	uint8_t *data{nullptr};
+	size_t size{0};
+	size_t capacity{0};
+	size_t position{0};
+	bool error{false};
+};
+
+class system_t;
+
+/*
+ * Snapshots of the complete machine: cpu, core, timer, exceptions,
+ * blitter, sound and keyboard state plus vram. The squirrel vm of the
+ * commander can't be serialised and is left alone.
+ *
+ * A full snapshot holds all vram pages (run length encoded). An
+ * incremental snapshot only holds the pages that differ from the
+ * previous snapshot taken or restored, stored as the run length
+ * encoded xor of old and new contents. A reference copy of vram at
+ * that moment is kept to encode them, the dirty page tracking of the
+ * blitter tells which pages need to be compared at all. Restoring works from
+ * the same point: a full snapshot, followed by its incremental ones
+ * in order. Xor deltas are their own inverse, applying one to the
+ * newer vram yields the older one, see step_back().
+ *
+ * Snapshots are taken and restored in between frames or debugger
+ * steps, never while the cpu is running.
+ */
+enum state_kind {
+	STATE_FULL = 0,
+	STATE_INCREMENTAL = 1
+};
+
+class snapshot_t {
+public:
+	snapshot_t(system_t *s);
+	~snapshot_t();
+
+	void take(state_t *state, enum state_kind kind);
+
+	/*
+	 * Returns false (machine untouched) on a corrupt state or an
+	 * incremental one that doesn't follow the previous snapshot
+	 */
+	bool restore(state_t *state);
+
+	/*
+	 * Goes back from the newest (incremental) snapshot to the one
+	 * before, the xor delta of the newest one is undone
+	 */
+	bool step_back(state_t *newest, state_t *previous);
+
+	/*
+	 * Back to the newest snapshot itself (the last one taken or
+	 * restored), e.g. after running part of a frame
+	 */
+	bool revert(state_t *newest);
+
+	/*
+	 * Duration of the last take(), restore(), step_back() or revert()
+	 * in milliseconds
+	 */
+	inline double get_duration_ms() { return duration_ms; }
+
+private:
+	system_t *system;
+
+	/*
+	 * Vram as of the last snapshot taken or restored
+	 */
+	uint8_t *reference{nullptr};
+	uint64_t reference_id{0};
+
+	/*
+	 * Only pages written since (see blitter_ic) can differ from the
+	 * reference
+	 */
+	uint32_t checkpoint{0};
+	uint64_t next_id;
+
+	double duration_ms{0};
+
+	/*
+	 * Machine state apart from vram, serialised separately so a
+	 * restore can check all pages before touching anything
+	 */
+	state_t machine;
+
+	struct header_t {
+		uint8_t kind;
+		uint64_t id;
+		uint64_t base_id;
+		uint32_t machine_size;
+		const uint8_t *machine_data;
+		size_t pages_position;
+	};
+
+	void put_page(state_t *state, const uint8_t *page, const uint8_t *ref);
+	bool get_page(state_t *state, uint8_t *page);
+	bool check_pages(state_t *state);
+	bool read_header(state_t *state, struct header_t *header);
+	void revert_vram();
+	void apply_delta(state_t *state, struct header_t *header);
+	void load_machine(struct header_t *header);
+};
+
+#endif
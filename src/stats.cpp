@@ -30,6 +30,16 @@ void stats_t::reset()
 
 	audio_queue_size_ms = 0;
 	smoothed_audio_queue_size_ms = 0;
+	audio_ratio = 1.0;
+	audio_underruns = 0;
+
+	present_interval_ms = 0.0;
+	present_jitter_ms = 0.0;
+	dropped_frames = 0;
+
+	oversleep_us = 0.0;
+	spin_us = 0.0;
+	lateness_us = 0.0;
 	
 	smoothed_framerate = FPS;
 	
@@ -97,12 +107,22 @@ void stats_t::process_parameters()
 	if (status_bar_framecounter == status_bar_framecounter_interval) {
 		status_bar_framecounter = 0;
 
-		snprintf(statistics_string, 256,
+		snprintf(statistics_string, 512,
 			"\n  frametime: %5.2f ms     cpu load:%6.2f %%\n"
 			"       core: %5.2f ms  audiobuffer: %5.2f ms\n"
-			"        cpu: %5.2f mHz   framerate:%6.2f fps\n",
+			"        cpu: %5.2f mHz   framerate:%6.2f fps\n"
+			"   resample: %7.5f    underruns: %u\n"
+			"    present: %5.2f ms       jitter: %5.2f ms\n"
+			"    dropped: %u\n"
+			"  oversleep: %5.0f us        spin: %5.0f us\n"
+			"   lateness: %5.0f us\n",
 			(smoothed_core_per_frame+smoothed_idle_per_frame)/1000, cpu_percentage,
 			smoothed_core_per_frame/1000, smoothed_audio_queue_size_ms,
-			smoothed_cpu_mhz, smoothed_framerate);
+			smoothed_cpu_mhz, smoothed_framerate,
+			audio_ratio, audio_underruns,
+			present_interval_ms, present_jitter_ms,
+			dropped_frames,
+			oversleep_us, spin_us,
+			lateness_us);
 	}
 }
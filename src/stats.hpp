@@ -44,6 +44,16 @@ private:
 
 	double audio_queue_size_ms;
 	double smoothed_audio_queue_size_ms;
+	double audio_ratio;
+	uint32_t audio_underruns;
+
+	double present_interval_ms;
+	double present_jitter_ms;
+	uint32_t dropped_frames;
+
+	double oversleep_us;
+	double spin_us;
+	double lateness_us;
 
 	double core_per_frame;
 	double smoothed_core_per_frame;
@@ -52,7 +62,7 @@ private:
 	
 	double cpu_percentage;
     
-	char statistics_string[256];
+	char statistics_string[512];
 	
 	system_t *system;
     
@@ -84,6 +94,26 @@ public:
 		audio_queue_size_ms = b;
 	}
 	
+	inline void set_audio_resampling(double ratio, uint32_t underruns)
+	{
+		audio_ratio = ratio;
+		audio_underruns = underruns;
+	}
+	
+	inline void set_video_presentation(double interval, double jitter, uint32_t dropped)
+	{
+		present_interval_ms = interval;
+		present_jitter_ms = jitter;
+		dropped_frames = dropped;
+	}
+	
+	inline void set_pacing(double oversleep, double spin, double lateness)
+	{
+		oversleep_us = oversleep;
+		spin_us = spin;
+		lateness_us = lateness;
+	}
+	
 	inline double get_smoothed_audio_queue_size_ms() { return smoothed_audio_queue_size_ms; }
 
 	// process calculations on parameters (fps/mhz/buffersize)
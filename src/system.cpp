@@ -11,8 +11,10 @@
 #include "keyboard.hpp"
 #include "debugger.hpp"
 #include "stats.hpp"
+#include "state.hpp"
+#include "rewind.hpp"
 
-system_t::system_t()
+system_t::system_t(bool headless)
 {
 	system_start_time = std::chrono::steady_clock::now();
 
@@ -21,7 +23,7 @@ system_t::system_t()
 	       PUNCH_MINOR_VERSION,
 	       PUNCH_BUILD, PUNCH_YEAR);
 
-	host = new host_t(this);
+	host = new host_t(this, headless);
 
 	core = new core_t(this);
 
@@ -33,6 +35,9 @@ system_t::system_t()
 
 	stats = new stats_t(this);
 
+	snapshot = new snapshot_t(this);
+	rewind_buffer = new rewind_t(this);
+
 	/*
 	 * Default start mode
 	 */
@@ -44,6 +49,8 @@ system_t::system_t()
 
 system_t::~system_t()
 {
+	delete rewind_buffer;
+	delete snapshot;
 	delete stats;
 	delete keyboard;
 	delete core;
@@ -78,30 +85,42 @@ void system_t::switch_to_run_mode()
 	current_mode = RUN_MODE;
 }
 
+/*
+ * The main thread keeps the window, events and presenting (see
+ * host_t), the machine runs on an emulation thread
+ */
 void system_t::run()
 {
 	running = true;
 
+	std::thread emulation(&system_t::run_emulation, this);
+	host->run_display();
+	emulation.join();
+}
+
+void system_t::run_emulation()
+{
 	stats->reset();
 
 	end_of_frame_time = std::chrono::steady_clock::now();
 
 	while (running) {
 		/*
-		 * Audio: Measure audio_buffer and determine audio_cycles to run
+		 * Vram may still be offered to the main thread
 		 */
-		uint32_t audio_buffer_bytes = host->get_queued_audio_size_bytes();
-		stats->set_queued_audio_ms(audio_buffer_bytes / host->get_bytes_per_ms());
-
-		int32_t audio_cycles = SID_CYCLES_PER_FRAME;
+		host->video_reclaim();
 
-		if (audio_buffer_bytes > (AUDIO_BUFFER_SIZE * 1.2)) {
-			audio_cycles -= SID_CYCLES_PER_FRAME / 5;
-		} else if (audio_buffer_bytes < (AUDIO_BUFFER_SIZE * 0.8)) {
-			audio_cycles += SID_CYCLES_PER_FRAME / 5;
-		}
+		/*
+		 * Audio: sound runs at its nominal speed, drift between
+		 * emulation and audio device is absorbed by the resampler
+		 * on the host side.
+		 */
+		stats->set_queued_audio_ms(host->get_audio_latency_ms());
+		stats->set_audio_resampling(host->get_audio_ratio(), host->get_audio_underruns());
+		stats->set_video_presentation(host->get_present_interval_ms(), host->get_present_jitter_ms(), host->get_dropped_frames());
+		stats->set_pacing(pacer.get_oversleep_us(), pacer.get_spin_us(), pacer.get_lateness_us());
 
-		core->cpu2sid->adjust_target_clock(audio_cycles);
+		core->cpu2sid->adjust_target_clock(SID_CYCLES_PER_FRAME);
 
 		if (host->events_process_events() == QUIT_EVENT) running = false;
 
@@ -109,59 +128,176 @@ void system_t::run()
 
 		switch (current_mode) {
 			case RUN_MODE:
-				if (core->run(false) == BREAKPOINT) {
-					switch_mode();
-				}
+				run_frames();
 				break;
 			case DEBUG_MODE:
 				debugger->run();
-				debugger->redraw();
-				//debugger->blitter->update_framebuffer();
-				host->update_debugger_texture((uint32_t *)&debugger->blitter->vram[FRAMEBUFFER_ADDRESS]);
+				if (debugger->redraw()) {
+					//debugger->blitter->update_framebuffer();
+					host->update_debugger_texture((uint32_t *)&debugger->blitter->vram[FRAMEBUFFER_ADDRESS]);
+				}
+				finish_frame_sound();
 				break;
 		}
 
-		uint32_t sound_cycle_saldo = core->get_sound_cycle_saldo();
-		if (sound_cycle_saldo < audio_cycles ) {
-			core->sound->run(audio_cycles - sound_cycle_saldo);
-		}
-
 		//core->blitter->update_framebuffer();
 
 		host->update_core_texture((uint32_t *)&core->blitter->vram[FRAMEBUFFER_ADDRESS]);
+		host->dump_core_frame((uint32_t *)&core->blitter->vram[FRAMEBUFFER_ADDRESS]);
 
 		//printf("%s", stats->summary());
 
+		/*
+		 * Hand the frame to the main thread, presenting (and a
+		 * possible vsync wait) happens there
+		 */
+		host->update_screen();
+
 		// Time measurement
 		stats->start_idle_time();
 
 		/*
-		 * If vsync is enabled, the update screen function takes more
-		 * time, i.e. it will return after a few milliseconds, exactly
-		 * when vertical refresh is done. This will avoid tearing.
-		 * There's no need then to let the system sleep with a
-		 * calculated value. But we will still have to do a time
-		 * measurement for estimation of idle time.
-		 *
-		 * When there's no vsync, sleep time is done manually.
+		 * Emulation keeps its own 60Hz pace, independent of the
+		 * display
+		 */
+		end_of_frame_time += std::chrono::microseconds(1000000/FPS);
+		/*
+		 * If the next update is in the past, calculate a
+		 * new update moment.
 		 */
-		if (host->vsync_disabled() || (stats->current_smoothed_framerate() > (FPS + 1))) {
-			end_of_frame_time += std::chrono::microseconds(1000000/FPS);
-			/*
-			 * If the next update is in the past, calculate a
-			 * new update moment.
-			 */
-			if (end_of_frame_time > std::chrono::steady_clock::now()) {
-				std::this_thread::sleep_until(end_of_frame_time);
-			} else {
-				end_of_frame_time = std::chrono::steady_clock::now();
-			}
+		if (!pacer.wait_until(end_of_frame_time)) {
+			end_of_frame_time = std::chrono::steady_clock::now();
 		}
 
-		host->update_screen();
-
 		stats->start_core_time();
 
 		stats->process_parameters();
 	}
+
+	host->stop_display();
+}
+
+void system_t::finish_frame_sound()
+{
+	uint32_t sound_cycle_saldo = core->get_sound_cycle_saldo();
+	if (sound_cycle_saldo < SID_CYCLES_PER_FRAME) {
+		core->sound->run(SID_CYCLES_PER_FRAME - sound_cycle_saldo);
+	}
+}
+
+/*
+ * Runs one emulated frame per host frame, or more in turbo mode. Only
+ * the audio of the first one is kept (or silenced), see host_t.
+ */
+void system_t::run_frames()
+{
+	std::chrono::time_point<std::chrono::steady_clock> deadline =
+		end_of_frame_time + std::chrono::microseconds((1000000 / FPS) - TURBO_MAX_MARGIN_US);
+
+	uint32_t frame = 0;
+
+	for (;;) {
+		host->set_audio_turbo_frame(turbo != 1, frame == 0, turbo_audio_stretch);
+
+		if (core->run(false) == BREAKPOINT) {
+			finish_frame_sound();
+			switch_mode();
+			break;
+		}
+		finish_frame_sound();
+		rewind_buffer->capture();
+		frame++;
+
+		if (turbo == TURBO_MAX) {
+			if (std::chrono::steady_clock::now() >= deadline) break;
+			if (frame >= TURBO_MAX_FRAMES) break;
+		} else if (frame >= turbo) {
+			break;
+		}
+	}
+
+	host->end_audio_turbo();
+}
+
+void system_t::cycle_turbo()
+{
+	switch (turbo) {
+		case 1:  turbo = 2; break;
+		case 2:  turbo = 4; break;
+		case 4:  turbo = TURBO_MAX; break;
+		default: turbo = 1; break;
+	}
+	if (turbo == TURBO_MAX) {
+		printf("[punch] turbo max\n");
+	} else {
+		printf("[punch] turbo %ux\n", turbo);
+	}
+}
+
+void system_t::run_headless(uint32_t frames)
+{
+	running = true;
+
+	uint32_t frame = 0;
+
+	start_headless();
+
+	std::chrono::time_point<std::chrono::steady_clock> start = std::chrono::steady_clock::now();
+
+	while (running && ((frames == 0) || (frame < frames))) {
+		run_headless_frame();
+		frame++;
+	}
+
+	double seconds = (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000000;
+	printf("[punch] headless: %u frames in %.2f seconds (%.1f fps, %.1fx realtime)\n",
+	       frame, seconds, frame / seconds, (frame / seconds) / FPS);
+}
+
+void system_t::start_headless()
+{
+	/*
+	 * Without an audio device there's nothing to steer, sound runs at
+	 * exactly its nominal speed.
+	 */
+	core->cpu2sid->adjust_target_clock(SID_CYCLES_PER_FRAME);
+}
+
+void system_t::run_headless_frame()
+{
+	/*
+	 * A breakpoint doesn't end the frame, just continue
+	 */
+	while (core->run(false) == BREAKPOINT) {}
+
+	finish_frame_sound();
+
+	host->dump_core_frame((uint32_t *)&core->blitter->vram[FRAMEBUFFER_ADDRESS]);
+}
+
+bool system_t::save_state(const char *path)
+{
+	state_t state;
+	snapshot->take(&state, STATE_FULL);
+	if (!state.save(path)) {
+		printf("[punch] error: can't write state to '%s'\n", path);
+		return false;
+	}
+	printf("[punch] state saved to '%s' (%zu bytes in %.2f ms)\n", path, state.get_size(), snapshot->get_duration_ms());
+	return true;
+}
+
+bool system_t::load_state(const char *path)
+{
+	state_t state;
+	if (!state.load(path)) {
+		printf("[punch] error: can't read state from '%s'\n", path);
+		return false;
+	}
+	if (!snapshot->restore(&state)) {
+		printf("[punch] error: '%s' can't be restored\n", path);
+		return false;
+	}
+	printf("[punch] state loaded from '%s' (%.2f ms)\n", path, snapshot->get_duration_ms());
+	return true;
 }
@@ -10,6 +10,15 @@
 
 #include <chrono>
 #include <thread>
+#include "pacer.hpp"
+
+/*
+ * Turbo: number of emulated frames per host frame, TURBO_MAX runs as
+ * many as fit in a host frame (leaving some time to present)
+ */
+#define TURBO_MAX		0
+#define TURBO_MAX_FRAMES	64
+#define TURBO_MAX_MARGIN_US	3000
 
 enum mode {
 	DEBUG_MODE = 0,
@@ -21,13 +30,20 @@ class core_t;
 class keyboard_t;
 class debugger_t;
 class stats_t;
+class snapshot_t;
+class rewind_t;
 
 class system_t {
 private:
 	std::chrono::time_point<std::chrono::steady_clock> system_start_time;
 	std::chrono::time_point<std::chrono::steady_clock> end_of_frame_time;
+	pacer_t pacer;
+
+	void run_emulation();
+	void run_frames();
+	void finish_frame_sound();
 public:
-	system_t();
+	system_t(bool headless = false);
 	~system_t();
 	
 	host_t *host;
@@ -35,6 +51,8 @@ public:
 	keyboard_t *keyboard;
 	debugger_t *debugger;
 	stats_t *stats;
+	snapshot_t *snapshot;
+	rewind_t *rewind_buffer;
 	
 	enum mode current_mode;
 	void switch_mode();
@@ -42,6 +60,33 @@ public:
 	void switch_to_run_mode();
 	
 	void run();
+
+	/*
+	 * Turbo mode (1, 2, 4 or TURBO_MAX). Audio is time stretched by
+	 * only keeping the first frame of each host frame, or silenced.
+	 */
+	uint32_t turbo{1};
+	bool turbo_audio_stretch{true};
+	void cycle_turbo();
+
+	/*
+	 * No host audio, video, events and syncing. Runs frames as fast
+	 * as possible, either forever (0) or for a number of frames.
+	 */
+	void run_headless(uint32_t frames);
+
+	/*
+	 * Same, one frame at a time (e.g. for runner_t). start_headless()
+	 * goes first, once.
+	 */
+	void start_headless();
+	void run_headless_frame();
+
+	/*
+	 * Full machine snapshot from and to a file
+	 */
+	bool save_state(const char *path);
+	bool load_state(const char *path);
 	
 	bool running;
 };
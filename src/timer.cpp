@@ -36,6 +36,28 @@ void timer_ic::reset()
 	exceptions->release(irq_number);
 }
 
+void timer_ic::save_state(state_t *s)
+{
+	s->put(status_register);
+	s->put(control_register);
+	for (int i=0; i<8; i++) {
+		s->put(timers[i].bpm);
+		s->put(timers[i].clock_interval);
+		s->put(timers[i].counter);
+	}
+}
+
+void timer_ic::load_state(state_t *s)
+{
+	s->get(status_register);
+	s->get(control_register);
+	for (int i=0; i<8; i++) {
+		s->get(timers[i].bpm);
+		s->get(timers[i].clock_interval);
+		s->get(timers[i].counter);
+	}
+}
+
 void timer_ic::run(uint32_t number_of_cycles)
 {
 	for (int i=0; i<8; i++) {
@@ -49,6 +71,21 @@ void timer_ic::run(uint32_t number_of_cycles)
 	}
 }
 
+uint32_t timer_ic::cycles_to_next_event()
+{
+	uint32_t result = 0xffffffff;
+	
+	for (int i=0; i<8; i++) {
+		if (control_register & (0b1 << i)) {
+			uint32_t remaining = (timers[i].counter >= timers[i].clock_interval) ?
+				0 : timers[i].clock_interval - timers[i].counter;
+			if (remaining < result) result = remaining;
+		}
+	}
+	
+	return result;
+}
+
 uint32_t timer_ic::bpm_to_clock_interval(uint16_t bpm)
 {
 	return (60.0 / bpm) * CPU_CLOCK_SPEED;
@@ -55,6 +55,7 @@
 
 #include <cstdint>
 #include "exceptions.hpp"
+#include "state.hpp"
 
 struct timer_unit {
 	uint16_t bpm;
@@ -92,11 +93,17 @@ public:
 
 	// run cycles on this ic
 	void run(uint32_t number_of_cycles);
+
+	// cycles until the next interrupt of an active timer
+	uint32_t cycles_to_next_event();
 	
 	// convenience function (turning on specific timer + bpm)
 	void set(uint8_t timer_no, uint16_t bpm);
 	
 	void status(char *buffer, uint8_t timer_no);
+
+	void save_state(state_t *s);
+	void load_state(state_t *s);
 };
 
 #endif
@@ -0,0 +1,67 @@
+/*
+ * triple_buffer.hpp
+ * punch
+ *
+ * Copyright © 2025 elmerucr. All rights reserved.
+ */
+
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Lock-free triple buffer, one producer and one consumer. The producer
+ * fills back() and publishes it, the consumer takes the most recently
+ * published buffer. Neither side ever waits for the other, a frame that
+ * is published before the consumer took the previous one replaces it.
+ */
+template <typename T>
+class triple_buffer_t {
+private:
+	T buffers[3];
+
+	/*
+	 * Index of the published buffer, plus a flag telling whether it
+	 * is new to the consumer
+	 */
+	static constexpr uint8_t FRESH = 0b100;
+	std::atomic<uint8_t> ready{1};
+
+	uint8_t back_index{0};		// producer only
+	uint8_t front_index{2};		// consumer only
+
+	std::atomic<uint32_t> replaced{0};
+
+public:
+	/*
+	 * Producer side
+	 */
+	inline T &back() { return buffers[back_index]; }
+
+	inline void publish() {
+		uint8_t previous = ready.exchange(back_index | FRESH, std::memory_order_acq_rel);
+		if (previous & FRESH) replaced++;
+		back_index = previous & 0b11;
+	}
+
+	/*
+	 * Consumer side, returns false when nothing new was published
+	 * since the last call
+	 */
+	inline bool acquire() {
+		if (!(ready.load(std::memory_order_acquire) & FRESH)) return false;
+		front_index = ready.exchange(front_index, std::memory_order_acq_rel) & 0b11;
+		return true;
+	}
+
+	inline const T &front() const { return buffers[front_index]; }
+
+	/*
+	 * Number of published buffers that were never taken
+	 */
+	inline uint32_t get_replaced() const { return replaced; }
+};
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * analog_regression.cpp
+ * punch
+ *
+ * Copyright © 2025 elmerucr. All rights reserved.
+ */
+
+/*
+ * Audio regression test of the analog voices. A voice is taken through
+ * all waveforms, envelopes and pitch bends, in runs of odd sizes, and
+ * the samples are compared to a golden file. The golden file was made
+ * by the per sample engine that preceded block processing, samples may
+ * differ by at most 1 lsb. That engine already had the fix for the
+ * sawtooth falling through into noise (missing break in the waveform
+ * switch). Regenerating the file from an older tree, without that fix,
+ * gives a different "sawtooth, bend down" case.
+ *
+ * analog_regression <golden>		compare
+ * analog_regression <golden> --write	(re)create golden file
+ *
+ * Golden file: signed 16 bit mono samples, little endian.
+ */
+
+#include "analog.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define MAX_DIFFERENCE	1
+
+struct case_t {
+	const char *description;
+	uint8_t control;	// waveform, pitch up, pitch bend (gate is set by the test)
+	uint8_t pitch_factor;
+	uint16_t frequency;
+	uint16_t duty;
+	uint16_t attack;
+	uint16_t decay;
+	uint16_t sustain;
+	uint16_t release;
+	uint16_t pitch_bend_duration;
+	uint32_t gate_samples;
+	uint32_t release_samples;
+};
+
+static const case_t cases[] = {
+	{ "sine, no bend",               0x00,  0, 0x1d45, 0x8000,   100,  50, 0x8000,  40,   0, 3600, 1800 },
+	{ "triangle, bend down",         0x12, 12, 0x08b4, 0x8000,    20,  80, 0xc000,  30, 300, 3600, 1800 },
+	{ "square, bend up",             0x26, 24, 0x1167, 0x4000,     2,  60, 0x6000,  50, 500, 3600, 1800 },
+	{ "sawtooth, bend down",         0x32, 36, 0x2bda, 0x8000,    50,  40, 0x4000,  20, 256, 3600, 1800 },
+	{ "noise",                       0x40,  0, 0x1d45, 0x8000,    10,  30, 0x2000,  30,   0, 3600, 1800 },
+	{ "sine, retrigger in release",  0x00,  0, 0x3a89, 0x8000,   200,  20, 0xffff, 100,   0, 2400,  600 },
+	{ "square, narrow, bend off",    0x20, 12, 0x0e00, 0x1000,     5, 100, 0x0000,  10, 200, 3600, 1800 },
+	{ "sine, low frequency",         0x00,  0, 0x0100, 0x8000,  1000, 200, 0x8000, 200,   0, 4800, 2400 }
+};
+
+/*
+ * Run sizes cycle through this list, to cross block and stage
+ * boundaries at odd moments
+ */
+static const uint16_t run_sizes[] = { 1, 7, 64, 255, 256, 257, 300, 33, 800 };
+
+static void write_word(analog_ic *voice, uint8_t address, uint16_t value)
+{
+	voice->write_byte(address, value >> 8);
+	voice->write_byte(address + 1, value & 0xff);
+}
+
+static void render(analog_ic *voice, uint32_t samples, std::vector<int16_t> &output, int &run)
+{
+	int16_t buffer[800];
+
+	while (samples) {
+		uint16_t n = run_sizes[run++ % (sizeof(run_sizes) / sizeof(run_sizes[0]))];
+		if (n > samples) n = samples;
+		voice->run(n, buffer);
+		output.insert(output.end(), buffer, buffer + n);
+		samples -= n;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		printf("usage: %s <golden> [--write]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	bool write = (argc > 2) && (strcmp(argv[2], "--write") == 0);
+
+	std::vector<int16_t> output;
+	std::vector<size_t> case_start;
+
+	for (const case_t &c : cases) {
+		analog_ic voice(0);
+		int run = 0;
+
+		case_start.push_back(output.size());
+
+		voice.write_byte(0x01, c.pitch_factor);
+		write_word(&voice, 0x02, c.frequency);
+		write_word(&voice, 0x04, c.duty);
+		write_word(&voice, 0x06, c.attack);
+		write_word(&voice, 0x08, c.decay);
+		write_word(&voice, 0x0a, c.sustain);
+		write_word(&voice, 0x0c, c.release);
+		write_word(&voice, 0x0e, c.pitch_bend_duration);
+
+		voice.write_byte(0x00, c.control | 0x01);
+		render(&voice, c.gate_samples, output, run);
+		voice.write_byte(0x00, c.control);
+		render(&voice, c.release_samples, output, run);
+
+		/*
+		 * Gate opened once more, while (possibly) still releasing
+		 */
+		voice.write_byte(0x00, c.control | 0x01);
+		render(&voice, c.gate_samples / 2, output, run);
+		voice.write_byte(0x00, c.control);
+		render(&voice, c.release_samples, output, run);
+	}
+
+	if (write) {
+		FILE *f = fopen(argv[1], "wb");
+		if (!f || (fwrite(output.data(), sizeof(int16_t), output.size(), f) != output.size())) {
+			printf("can't write %s\n", argv[1]);
+			return EXIT_FAILURE;
+		}
+		fclose(f);
+		printf("%zu samples written to %s\n", output.size(), argv[1]);
+		return EXIT_SUCCESS;
+	}
+
+	FILE *f = fopen(argv[1], "rb");
+	if (!f) {
+		printf("can't open %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	std::vector<int16_t> golden(output.size() + 1);
+	size_t n = fread(golden.data(), sizeof(int16_t), golden.size(), f);
+	fclose(f);
+	if (n != output.size()) {
+		printf("golden file has %zu samples, expected %zu\n", n, output.size());
+		return EXIT_FAILURE;
+	}
+
+	bool passed = true;
+	for (size_t i=0; i<(sizeof(cases) / sizeof(cases[0])); i++) {
+		size_t end = (i + 1 < case_start.size()) ? case_start[i + 1] : output.size();
+		int max_difference = 0;
+		size_t differing = 0;
+		for (size_t j=case_start[i]; j<end; j++) {
+			int difference = abs(output[j] - golden[j]);
+			if (difference) differing++;
+			if (difference > max_difference) max_difference = difference;
+		}
+		bool ok = max_difference <= MAX_DIFFERENCE;
+		printf("%-28s max difference %i, %zu of %zu samples differ %s\n",
+			cases[i].description, max_difference, differing, end - case_start[i], ok ? "" : "FAILED");
+		passed = passed && ok;
+	}
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
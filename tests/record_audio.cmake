@@ -0,0 +1,43 @@
+# record_audio.cmake
+# punch
+#
+# Regression test of --record. A headless run of 30 frames is recorded
+# and dumped (--dump-audio) at the same time. Headless recordings are
+# lossless, so the wav file must have the expected header, followed by
+# exactly the dumped samples.
+#
+# cmake -DPUNCH=<punch> -DOUTPUT_DIR=<dir> -P record_audio.cmake
+
+set(WAV ${OUTPUT_DIR}/record_audio.wav)
+set(RAW ${OUTPUT_DIR}/record_audio.raw)
+
+# RIFF size, WAVE, fmt chunk (float, 2 channels, 48000 Hz, 32 bit), data size
+string(CONCAT EXPECTED_HEADER
+	"52494646" "a4ee0200" "57415645"
+	"666d7420" "10000000" "0300" "0200" "80bb0000" "00dc0500" "0800" "2000"
+	"64617461" "80ee0200"
+)
+
+file(REMOVE ${WAV} ${RAW})
+
+execute_process(
+	COMMAND ${PUNCH} --headless --frames 30 --record ${WAV} --dump-audio ${RAW}
+	RESULT_VARIABLE RESULT
+	OUTPUT_QUIET
+)
+if(NOT RESULT EQUAL 0)
+	message(FATAL_ERROR "punch exited with ${RESULT}")
+endif()
+
+file(READ ${WAV} HEADER LIMIT 44 HEX)
+if(NOT HEADER STREQUAL EXPECTED_HEADER)
+	message(FATAL_ERROR "wav header\n  ${HEADER}\nexpected\n  ${EXPECTED_HEADER}")
+endif()
+
+file(READ ${WAV} DATA OFFSET 44 HEX)
+file(READ ${RAW} DUMP HEX)
+if(NOT DATA STREQUAL DUMP)
+	message(FATAL_ERROR "recorded samples differ from --dump-audio")
+endif()
+
+message(STATUS "record_audio: header and samples ok")
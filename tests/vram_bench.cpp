@@ -0,0 +1,124 @@
+/*
+ * vram_bench.cpp
+ * punch
+ *
+ * Copyright © 2025 elmerucr. All rights reserved.
+ */
+
+/*
+ * Benchmark of vram dirty page tracking. A headless machine does a
+ * blit heavy frame (clear, glyphs, sprites, lines, pixels and cpu
+ * writes into vram), followed by the incremental snapshot rewind takes
+ * every frame. Built twice, as vram_bench_tracked and as
+ * vram_bench_untracked (VRAM_DIRTY_TRACKING 0, all pages compared).
+ * Both run from the build directory with
+ *
+ * cmake --build . --target vram_bench
+ *
+ * vram_bench_tracked [frames]
+ * vram_bench_untracked [frames]
+ */
+
+#include "system.hpp"
+#include "core.hpp"
+#include "blitter.hpp"
+#include "state.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#define DEFAULT_FRAMES	600
+#define GLYPHS		1200
+#define SPRITES		64
+#define LINES		200
+#define PIXELS_SET	2000
+#define CPU_WRITES	8192
+
+#define SPRITE_ADDRESS	0x100000
+
+static void frame(core_t *core, uint32_t n)
+{
+	blitter_ic *blitter = core->blitter;
+
+	blitter->set_pixel_saldo(MAX_PIXELS_PER_FRAME);
+
+	blitter->clear_surface(0x0);
+
+	for (int i=0; i<GLYPHS; i++) {
+		blitter->surface[0xe].x = (i * 4) % MAX_PIXELS_PER_SCANLINE;
+		blitter->surface[0xe].y = ((i * 4) / MAX_PIXELS_PER_SCANLINE) * 6;
+		blitter->blit(0xe, 0x0);
+	}
+
+	for (int i=0; i<SPRITES; i++) {
+		blitter->surface[0x1].x = ((n + i * 37) % (MAX_PIXELS_PER_SCANLINE + 16)) - 16;
+		blitter->surface[0x1].y = ((n * 3 + i * 11) % (MAX_SCANLINES + 16)) - 16;
+		blitter->blit(0x1, 0x0);
+	}
+
+	for (int i=0; i<LINES; i++) {
+		blitter->line(i % MAX_PIXELS_PER_SCANLINE, 0, (n + i) % MAX_PIXELS_PER_SCANLINE, MAX_SCANLINES - 1, 0x0);
+	}
+
+	for (int i=0; i<PIXELS_SET; i++) {
+		blitter->pset((n + i * 7) % MAX_PIXELS_PER_SCANLINE, (i * 13) % MAX_SCANLINES, 0x0);
+	}
+
+	/*
+	 * Through the memory map of the cpu, all below $10000 that is not io
+	 */
+	for (int i=0; i<CPU_WRITES; i++) {
+		core->write8(0x4000 + ((n * 64 + i) & 0x7fff), i & 0xff);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : DEFAULT_FRAMES;
+	if (!frames) frames = DEFAULT_FRAMES;
+
+	system_t system(true);
+	core_t *core = system.core;
+	state_t state;
+
+	/*
+	 * 16x16 32 bit sprite, half transparent
+	 */
+	surface_t *sprite = &core->blitter->surface[0x1];
+	sprite->w = 16;
+	sprite->h = 16;
+	sprite->base_address = SPRITE_ADDRESS;
+	sprite->flags_0 = 0x40;
+	sprite->flags_1 = 0x00;
+	sprite->flags_2 = 0x00;
+	for (uint32_t i=0; i<(16 * 16 * 4); i++) {
+		core->blitter->vram[SPRITE_ADDRESS + i] = ((i & 3) == 0) ? ((i & 0x40) ? 0xff : 0x00) : i;
+	}
+	core->blitter->mark_dirty_range(SPRITE_ADDRESS, 16 * 16 * 4);
+
+	system.snapshot->take(&state, STATE_FULL);
+
+	std::chrono::steady_clock::duration drawing{0}, snapshots{0};
+
+	for (uint32_t n=0; n<frames; n++) {
+		auto start = std::chrono::steady_clock::now();
+		frame(core, n);
+		auto middle = std::chrono::steady_clock::now();
+		system.snapshot->take(&state, STATE_INCREMENTAL);
+		auto end = std::chrono::steady_clock::now();
+
+		drawing += middle - start;
+		snapshots += end - middle;
+	}
+
+	auto us = [frames](std::chrono::steady_clock::duration d) {
+		return (double)std::chrono::duration_cast<std::chrono::microseconds>(d).count() / frames;
+	};
+
+	printf("dirty tracking %s, %u frames\n", VRAM_DIRTY_TRACKING ? "on" : "off", frames);
+	printf("  drawing   %9.1f us/frame\n", us(drawing));
+	printf("  snapshot  %9.1f us/frame (last one %zu bytes)\n", us(snapshots), state.get_size());
+	printf("  total     %9.1f us/frame\n", us(drawing + snapshots));
+
+	return EXIT_SUCCESS;
+}